@@ -0,0 +1,135 @@
+-- Planning benchmark driver. Run after queries.sql.
+CREATE TABLE bench.results (
+	mode TEXT,
+	workload TEXT,
+	name TEXT,
+	iterations INT,
+	errors INT,
+	mean_ms FLOAT8,
+	p50_ms FLOAT8,
+	p95_ms FLOAT8,
+	max_ms FLOAT8,
+	plans_per_sec FLOAT8,
+	bytes_per_plan FLOAT8
+);
+
+-- plain: hypocost off. recost: recosting only. substitute: recosting plus
+-- substituting every single-column index by a wider index on the same table.
+-- Partitioned indexes have no storage and never appear in a plan, so on
+-- partitioned tables each partition's own index gets a rule, mapped to a
+-- hypothetical copy of the wider index on that partition when hypopg is
+-- installed, else to the partition's real wider index.
+CREATE FUNCTION bench.configure(mode TEXT) RETURNS INT AS $$
+DECLARE
+	rules INT := 0;
+	hypo BOOL := EXISTS (SELECT FROM pg_extension WHERE extname = 'hypopg');
+	r RECORD;
+	target OID;
+BEGIN
+	PERFORM hypocost_substitute_reset();
+	IF hypo THEN
+		PERFORM hypopg_reset();
+	END IF;
+	PERFORM set_config('hypocost.enable', (mode <> 'plain')::TEXT, false);
+	PERFORM set_config('hypocost.substitute', (mode = 'substitute')::TEXT, false);
+	PERFORM set_config('hypocost.alter_explain', 'off', false);
+	-- Only the measured EXPLAINs are recosted, not the driver's own statements.
+	PERFORM set_config('hypocost.activation', 'explain', false);
+
+	IF mode = 'substitute' THEN
+		SELECT count(hypocost_substitute_index(s.relname::TEXT, wi.indexrelid::REGCLASS)) INTO rules
+		FROM pg_index si
+		JOIN pg_class s ON s.oid = si.indexrelid
+		JOIN pg_namespace n ON n.oid = s.relnamespace
+		JOIN pg_index wi ON wi.indrelid = si.indrelid AND wi.indnatts > 1 AND wi.indkey[0] = si.indkey[0]
+		WHERE si.indnatts = 1 AND s.relkind = 'i' AND NOT s.relispartition AND n.nspname IN ('tpch', 'star', 'part');
+
+		FOR r IN
+			SELECT sc.relname, wh.inhrelid AS wide
+			FROM pg_index si
+			JOIN pg_class s ON s.oid = si.indexrelid
+			JOIN pg_namespace n ON n.oid = s.relnamespace
+			JOIN pg_index wi ON wi.indrelid = si.indrelid AND wi.indnatts > 1 AND wi.indkey[0] = si.indkey[0]
+			JOIN pg_inherits sh ON sh.inhparent = si.indexrelid
+			JOIN pg_inherits wh ON wh.inhparent = wi.indexrelid
+			JOIN pg_index sci ON sci.indexrelid = sh.inhrelid
+			JOIN pg_index wci ON wci.indexrelid = wh.inhrelid AND wci.indrelid = sci.indrelid
+			JOIN pg_class sc ON sc.oid = sci.indexrelid
+			WHERE si.indnatts = 1 AND s.relkind = 'I' AND n.nspname IN ('tpch', 'star', 'part')
+			ORDER BY sc.relname
+		LOOP
+			IF hypo THEN
+				SELECT indexrelid INTO target FROM hypopg_create_index(pg_get_indexdef(r.wide));
+			ELSE
+				target := r.wide;
+			END IF;
+			PERFORM hypocost_substitute_index(r.relname::TEXT, target::REGCLASS);
+			rules := rules + 1;
+		END LOOP;
+	END IF;
+	RETURN rules;
+END
+$$ LANGUAGE plpgsql;
+
+-- Planning time of one query in milliseconds, NULL if hypocost rejected it.
+CREATE FUNCTION bench.plan_time(query TEXT) RETURNS FLOAT8 AS $$
+DECLARE
+	plan JSON;
+BEGIN
+	EXECUTE 'EXPLAIN (FORMAT JSON, SUMMARY) ' || query INTO plan;
+	RETURN (plan -> 0 ->> 'Planning Time')::FLOAT8;
+EXCEPTION
+	WHEN feature_not_supported THEN
+		RETURN NULL;
+END
+$$ LANGUAGE plpgsql;
+
+CREATE FUNCTION bench.run(mode TEXT, iterations INT, warmup INT) RETURNS VOID AS $$
+DECLARE
+	q RECORD;
+	times FLOAT8[];
+	t FLOAT8;
+	errors INT;
+	started TIMESTAMPTZ;
+	wall FLOAT8;
+	mem FLOAT8;
+BEGIN
+	RAISE NOTICE '%: % substitution rules', mode, bench.configure(mode);
+	FOR q IN SELECT * FROM bench.queries ORDER BY workload, name LOOP
+		FOR i IN 1..warmup LOOP
+			PERFORM bench.plan_time(q.query);
+		END LOOP;
+
+		PERFORM hypocost_stat_reset();
+		times := '{}';
+		errors := 0;
+		started := clock_timestamp();
+		FOR i IN 1..iterations LOOP
+			t := bench.plan_time(q.query);
+			IF t IS NULL THEN
+				errors := errors + 1;
+			ELSE
+				times := times || t;
+			END IF;
+		END LOOP;
+		wall := extract(epoch FROM clock_timestamp() - started);
+
+		-- Memory is what hypocost allocates on top of the regular planner; the
+		-- planner's own memory is not measured, so plain mode reports NULL.
+		SELECT sum(mem_allocated)::FLOAT8 / nullif(sum(recosts), 0) INTO mem FROM pg_stat_hypocost;
+
+		INSERT INTO bench.results
+		SELECT mode, q.workload, q.name, iterations, errors,
+			avg(x), percentile_cont(0.5) WITHIN GROUP (ORDER BY x), percentile_cont(0.95) WITHIN GROUP (ORDER BY x), max(x),
+			iterations / nullif(wall, 0), mem
+		FROM unnest(times) x;
+	END LOOP;
+END
+$$ LANGUAGE plpgsql;
+
+CREATE FUNCTION bench.report(meta JSON) RETURNS JSON AS $$
+	SELECT json_build_object(
+		'version', version(),
+		'meta', meta,
+		'results', (SELECT json_agg(r ORDER BY r.workload, r.name, r.mode) FROM bench.results r))
+$$ LANGUAGE sql;
@@ -0,0 +1,68 @@
+-- Queries whose planning is measured, grouped by workload.
+DROP SCHEMA IF EXISTS bench CASCADE;
+CREATE SCHEMA bench;
+CREATE TABLE bench.queries (workload TEXT, name TEXT, query TEXT, PRIMARY KEY (workload, name));
+
+INSERT INTO bench.queries VALUES
+('tpch', 'q1', $q$
+SELECT l_returnflag, l_linestatus, sum(l_quantity), sum(l_extendedprice * (1 - l_discount)), avg(l_discount), count(*)
+FROM tpch.lineitem WHERE l_shipdate <= DATE '1998-09-02'
+GROUP BY l_returnflag, l_linestatus ORDER BY l_returnflag, l_linestatus
+$q$),
+('tpch', 'q3', $q$
+SELECT l_orderkey, sum(l_extendedprice * (1 - l_discount)) AS revenue, o_orderdate, o_shippriority
+FROM tpch.customer, tpch.orders, tpch.lineitem
+WHERE c_mktsegment = 'BUILDING' AND c_custkey = o_custkey AND l_orderkey = o_orderkey
+AND o_orderdate < DATE '1995-03-15' AND l_shipdate > DATE '1995-03-15'
+GROUP BY l_orderkey, o_orderdate, o_shippriority ORDER BY revenue DESC, o_orderdate LIMIT 10
+$q$),
+('tpch', 'q5', $q$
+SELECT n_name, sum(l_extendedprice * (1 - l_discount)) AS revenue
+FROM tpch.customer, tpch.orders, tpch.lineitem, tpch.supplier, tpch.nation, tpch.region
+WHERE c_custkey = o_custkey AND l_orderkey = o_orderkey AND l_suppkey = s_suppkey
+AND c_nationkey = s_nationkey AND s_nationkey = n_nationkey AND n_regionkey = r_regionkey
+AND r_name = 'REGION2' AND o_orderdate >= DATE '1994-01-01' AND o_orderdate < DATE '1995-01-01'
+GROUP BY n_name ORDER BY revenue DESC
+$q$),
+('tpch', 'q6', $q$
+SELECT sum(l_extendedprice * l_discount) FROM tpch.lineitem
+WHERE l_shipdate >= DATE '1994-01-01' AND l_shipdate < DATE '1995-01-01' AND l_discount BETWEEN 0.05 AND 0.07 AND l_quantity < 24
+$q$),
+('tpch', 'q9', $q$
+SELECT n_name, extract(year FROM o_orderdate) AS o_year, sum(l_extendedprice * (1 - l_discount) - ps_supplycost * l_quantity)
+FROM tpch.part, tpch.supplier, tpch.lineitem, tpch.partsupp, tpch.orders, tpch.nation
+WHERE s_suppkey = l_suppkey AND ps_suppkey = l_suppkey AND ps_partkey = l_partkey AND p_partkey = l_partkey
+AND o_orderkey = l_orderkey AND s_nationkey = n_nationkey AND p_name LIKE '%12%'
+GROUP BY n_name, o_year ORDER BY n_name, o_year DESC
+$q$),
+('tpch', 'q17', $q$
+SELECT sum(l_extendedprice) / 7.0 FROM tpch.lineitem, tpch.part
+WHERE p_partkey = l_partkey AND p_brand = 'Brand#23' AND p_container = 'CONTAINER7'
+AND l_quantity < (SELECT 0.2 * avg(l_quantity) FROM tpch.lineitem WHERE l_partkey = p_partkey)
+$q$),
+('tpch', 'q21', $q$
+SELECT s_name, count(*) AS numwait FROM tpch.supplier, tpch.lineitem l1, tpch.orders, tpch.nation
+WHERE s_suppkey = l1.l_suppkey AND o_orderkey = l1.l_orderkey AND o_orderstatus = 'F' AND l1.l_receiptdate > l1.l_commitdate
+AND EXISTS (SELECT * FROM tpch.lineitem l2 WHERE l2.l_orderkey = l1.l_orderkey AND l2.l_suppkey <> l1.l_suppkey)
+AND NOT EXISTS (SELECT * FROM tpch.lineitem l3 WHERE l3.l_orderkey = l1.l_orderkey AND l3.l_suppkey <> l1.l_suppkey AND l3.l_receiptdate > l3.l_commitdate)
+AND s_nationkey = n_nationkey AND n_name = 'NATION3'
+GROUP BY s_name ORDER BY numwait DESC, s_name LIMIT 100
+$q$),
+('partitioned', 'range', $q$
+SELECT kind, count(*) FROM part.events WHERE created BETWEEN DATE '2020-03-01' AND DATE '2020-06-01' AND account < 500 GROUP BY kind
+$q$),
+('partitioned', 'join', $q$
+SELECT a.region, count(*) FROM part.events e JOIN part.accounts a ON a.id = e.account
+WHERE a.region = 7 AND e.kind IN (1, 2, 3) GROUP BY a.region
+$q$),
+('partitioned', 'lookup', $q$
+SELECT * FROM part.events WHERE account = 42 ORDER BY created DESC LIMIT 20
+$q$);
+
+-- The star join spans every dimension that schema_star.sql created.
+INSERT INTO bench.queries
+SELECT 'star', 'join', 'SELECT d1.category, sum(f.amount) FROM star.fact f'
+	|| string_agg(format(' JOIN star.dim_%1$s d%1$s ON d%1$s.id = f.dim_%1$s_id', d), '' ORDER BY d)
+	|| ' WHERE ' || string_agg(format('d%s.category < %s', d, 5 + d % 10), ' AND ' ORDER BY d)
+	|| ' GROUP BY d1.category'
+FROM generate_series(1, (SELECT count(*) FROM pg_tables WHERE schemaname = 'star' AND tablename LIKE 'dim\_%')) d;
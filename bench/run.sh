@@ -0,0 +1,66 @@
+#!/bin/sh
+# Measure hypocost planning overhead on a throwaway local cluster.
+#
+# Usage: bench/run.sh [output.json]
+# Environment: PG_CONFIG, SCALE, ITERATIONS, WARMUP, DIMS, PARTS, MODES.
+set -eu
+
+PG_CONFIG=${PG_CONFIG:-pg_config}
+SCALE=${SCALE:-0.01}
+ITERATIONS=${ITERATIONS:-50}
+WARMUP=${WARMUP:-5}
+DIMS=${DIMS:-12}
+PARTS=${PARTS:-64}
+MODES=${MODES:-"plain recost substitute"}
+OUTPUT=${1:-bench-results.json}
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+BINDIR=$("$PG_CONFIG" --bindir)
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/hypocost-bench.XXXXXX")
+
+cleanup() {
+	"$BINDIR/pg_ctl" -D "$WORK/data" -m immediate stop >/dev/null 2>&1 || true
+	rm -rf "$WORK"
+}
+trap cleanup EXIT INT TERM
+
+"$BINDIR/initdb" -D "$WORK/data" -A trust -U postgres >/dev/null
+cat >> "$WORK/data/postgresql.conf" <<CONF
+shared_preload_libraries = 'hypocost'
+listen_addresses = ''
+unix_socket_directories = '$WORK'
+fsync = off
+CONF
+"$BINDIR/pg_ctl" -D "$WORK/data" -l "$WORK/server.log" -w start >/dev/null
+
+PSQL="$BINDIR/psql -X -q -v ON_ERROR_STOP=1 -h $WORK -U postgres -d postgres"
+
+echo "loading schemas (scale $SCALE, $DIMS dimensions, $PARTS partitions)"
+$PSQL -c "CREATE EXTENSION hypocost"
+# The substitute mode maps partition indexes to hypothetical ones when hypopg is installed.
+$PSQL -c "DO \$\$ BEGIN
+	IF EXISTS (SELECT FROM pg_available_extensions WHERE name = 'hypopg') THEN
+		CREATE EXTENSION hypopg;
+	END IF;
+END \$\$"
+$PSQL -v scale="$SCALE" -f "$BENCH_DIR/schema_tpch.sql"
+$PSQL -v scale="$SCALE" -v dims="$DIMS" -f "$BENCH_DIR/schema_star.sql"
+$PSQL -v scale="$SCALE" -v parts="$PARTS" -f "$BENCH_DIR/schema_partitioned.sql"
+$PSQL -f "$BENCH_DIR/queries.sql"
+$PSQL -f "$BENCH_DIR/driver.sql"
+
+# Every mode gets a fresh session so settings and substitution rules don't leak.
+for mode in $MODES; do
+	echo "planning in mode $mode"
+	$PSQL -c "SELECT bench.run('$mode', $ITERATIONS, $WARMUP)" >/dev/null
+done
+
+REVISION=$(git -C "$BENCH_DIR" rev-parse --short HEAD 2>/dev/null || echo unknown)
+$PSQL -At -c "SELECT bench.report(json_build_object(
+	'revision', '$REVISION',
+	'scale', $SCALE,
+	'iterations', $ITERATIONS,
+	'warmup', $WARMUP,
+	'dimensions', $DIMS,
+	'partitions', $PARTS))" > "$OUTPUT"
+echo "results written to $OUTPUT"
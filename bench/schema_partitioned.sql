@@ -0,0 +1,34 @@
+-- Range-partitioned table with :parts partitions and several indexes on each.
+DROP SCHEMA IF EXISTS part CASCADE;
+CREATE SCHEMA part;
+
+CREATE TABLE part.events (id BIGINT, account INT, kind INT, created DATE, payload TEXT) PARTITION BY RANGE (created);
+CREATE TABLE part.accounts (id INT PRIMARY KEY, region INT, name TEXT);
+
+-- psql does not substitute variables inside the DO body.
+SELECT set_config('bench.parts', :'parts', false);
+
+DO $$
+DECLARE
+	parts INT := current_setting('bench.parts')::INT;
+BEGIN
+	FOR p IN 0..parts - 1 LOOP
+		EXECUTE format('CREATE TABLE part.events_%s PARTITION OF part.events FOR VALUES FROM (%L) TO (%L)',
+			p, DATE '2020-01-01' + p * 7, DATE '2020-01-01' + (p + 1) * 7);
+	END LOOP;
+END
+$$;
+
+INSERT INTO part.accounts SELECT i, i % 50, 'account' || i FROM generate_series(1, 10000) i;
+INSERT INTO part.events SELECT i, 1 + i % 10000, i % 30, DATE '2020-01-01' + (i % (:parts * 7)), 'payload'
+	FROM generate_series(1, greatest(10000, (2000000 * :scale)::INT)) i;
+
+CREATE INDEX events_id_idx ON part.events (id);
+CREATE INDEX events_account_idx ON part.events (account);
+CREATE INDEX events_kind_idx ON part.events (kind);
+CREATE INDEX events_created_idx ON part.events (created);
+CREATE INDEX alt_events_account ON part.events (account, created);
+CREATE INDEX alt_events_kind ON part.events (kind, account);
+CREATE INDEX accounts_region_idx ON part.accounts (region);
+
+ANALYZE;
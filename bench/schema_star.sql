@@ -0,0 +1,32 @@
+-- Wide star schema: one fact table joined to :dims dimensions.
+DROP SCHEMA IF EXISTS star CASCADE;
+CREATE SCHEMA star;
+
+-- psql does not substitute variables inside the DO body.
+SELECT set_config('bench.dims', :'dims', false), set_config('bench.scale', :'scale', false);
+
+DO $$
+DECLARE
+	dims INT := current_setting('bench.dims')::INT;
+	nrows INT := greatest(1000, (1000000 * current_setting('bench.scale')::FLOAT8)::INT);
+	cols TEXT := '';
+	vals TEXT := '';
+BEGIN
+	FOR d IN 1..dims LOOP
+		EXECUTE format('CREATE TABLE star.dim_%s (id INT PRIMARY KEY, name TEXT, category INT)', d);
+		EXECUTE format('INSERT INTO star.dim_%s SELECT i, ''name'' || i, i %% 20 FROM generate_series(1, %s) i', d, 100 * d);
+		EXECUTE format('CREATE INDEX dim_%s_category_idx ON star.dim_%s (category)', d, d);
+		cols := cols || format(', dim_%s_id INT', d);
+		vals := vals || format(', 1 + (i * %s) %% %s', d + 1, 100 * d);
+	END LOOP;
+
+	EXECUTE format('CREATE TABLE star.fact (id INT PRIMARY KEY, amount NUMERIC%s)', cols);
+	EXECUTE format('INSERT INTO star.fact SELECT i, random() * 1000%s FROM generate_series(1, %s) i', vals, nrows);
+	FOR d IN 1..dims LOOP
+		EXECUTE format('CREATE INDEX fact_dim_%s_idx ON star.fact (dim_%s_id)', d, d);
+		EXECUTE format('CREATE INDEX alt_fact_dim_%s ON star.fact (dim_%s_id, amount)', d, d);
+	END LOOP;
+END
+$$;
+
+ANALYZE;
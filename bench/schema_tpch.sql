@@ -0,0 +1,56 @@
+-- TPC-H-like schema. :scale is the scale factor (1 = 1.5M orders).
+DROP SCHEMA IF EXISTS tpch CASCADE;
+CREATE SCHEMA tpch;
+SET search_path = tpch;
+
+CREATE TABLE region (r_regionkey INT PRIMARY KEY, r_name TEXT, r_comment TEXT);
+CREATE TABLE nation (n_nationkey INT PRIMARY KEY, n_name TEXT, n_regionkey INT, n_comment TEXT);
+CREATE TABLE supplier (s_suppkey INT PRIMARY KEY, s_name TEXT, s_address TEXT, s_nationkey INT, s_phone TEXT, s_acctbal NUMERIC, s_comment TEXT);
+CREATE TABLE customer (c_custkey INT PRIMARY KEY, c_name TEXT, c_address TEXT, c_nationkey INT, c_phone TEXT, c_acctbal NUMERIC, c_mktsegment TEXT, c_comment TEXT);
+CREATE TABLE part (p_partkey INT PRIMARY KEY, p_name TEXT, p_mfgr TEXT, p_brand TEXT, p_type TEXT, p_size INT, p_container TEXT, p_retailprice NUMERIC, p_comment TEXT);
+CREATE TABLE partsupp (ps_partkey INT, ps_suppkey INT, ps_availqty INT, ps_supplycost NUMERIC, ps_comment TEXT, PRIMARY KEY (ps_partkey, ps_suppkey));
+CREATE TABLE orders (o_orderkey INT PRIMARY KEY, o_custkey INT, o_orderstatus CHAR(1), o_totalprice NUMERIC, o_orderdate DATE, o_orderpriority TEXT, o_clerk TEXT, o_shippriority INT, o_comment TEXT);
+CREATE TABLE lineitem (l_orderkey INT, l_partkey INT, l_suppkey INT, l_linenumber INT, l_quantity NUMERIC, l_extendedprice NUMERIC, l_discount NUMERIC, l_tax NUMERIC, l_returnflag CHAR(1), l_linestatus CHAR(1), l_shipdate DATE, l_commitdate DATE, l_receiptdate DATE, l_shipinstruct TEXT, l_shipmode TEXT, l_comment TEXT, PRIMARY KEY (l_orderkey, l_linenumber));
+
+INSERT INTO region SELECT i, 'REGION' || i, 'comment' FROM generate_series(0, 4) i;
+INSERT INTO nation SELECT i, 'NATION' || i, i % 5, 'comment' FROM generate_series(0, 24) i;
+INSERT INTO supplier SELECT i, 'Supplier#' || i, 'addr', i % 25, 'phone', (random() * 10000)::NUMERIC(12, 2), 'comment'
+	FROM generate_series(1, greatest(10, (10000 * :scale)::INT)) i;
+INSERT INTO customer SELECT i, 'Customer#' || i, 'addr', i % 25, 'phone', (random() * 10000)::NUMERIC(12, 2),
+	(ARRAY['AUTOMOBILE', 'BUILDING', 'FURNITURE', 'HOUSEHOLD', 'MACHINERY'])[1 + i % 5], 'comment'
+	FROM generate_series(1, greatest(150, (150000 * :scale)::INT)) i;
+INSERT INTO part SELECT i, 'part ' || i, 'Manufacturer#' || (1 + i % 5), 'Brand#' || (1 + i % 25), 'TYPE' || (i % 150), 1 + i % 50,
+	'CONTAINER' || (i % 40), 900 + (i % 1000), 'comment'
+	FROM generate_series(1, greatest(200, (200000 * :scale)::INT)) i;
+INSERT INTO partsupp SELECT p.p_partkey, 1 + (p.p_partkey + s * 7) % greatest(10, (10000 * :scale)::INT), (random() * 9999)::INT, (random() * 1000)::NUMERIC(12, 2), 'comment'
+	FROM part p, generate_series(0, 3) s ON CONFLICT DO NOTHING;
+INSERT INTO orders SELECT i, 1 + i % greatest(150, (150000 * :scale)::INT), (ARRAY['F', 'O', 'P'])[1 + i % 3], (random() * 500000)::NUMERIC(12, 2),
+	DATE '1992-01-01' + (i % 2405), (1 + i % 5) || '-PRIORITY', 'Clerk#' || (i % 1000), 0, 'comment'
+	FROM generate_series(1, greatest(1500, (1500000 * :scale)::INT)) i;
+INSERT INTO lineitem SELECT o.o_orderkey, 1 + (o.o_orderkey * 7 + l) % greatest(200, (200000 * :scale)::INT), 1 + (o.o_orderkey + l) % greatest(10, (10000 * :scale)::INT), l,
+	1 + (random() * 49)::INT, (random() * 100000)::NUMERIC(12, 2), (random() * 0.1)::NUMERIC(4, 2), (random() * 0.08)::NUMERIC(4, 2),
+	(ARRAY['A', 'N', 'R'])[1 + l % 3], (ARRAY['F', 'O'])[1 + l % 2], o.o_orderdate + 1 + l * 10, o.o_orderdate + 30, o.o_orderdate + 2 + l * 10,
+	'DELIVER IN PERSON', (ARRAY['AIR', 'MAIL', 'RAIL', 'SHIP', 'TRUCK'])[1 + l % 5], 'comment'
+	FROM orders o, generate_series(1, 1 + o_orderkey % 7) l;
+
+CREATE INDEX nation_regionkey_idx ON nation (n_regionkey);
+CREATE INDEX supplier_nationkey_idx ON supplier (s_nationkey);
+CREATE INDEX customer_nationkey_idx ON customer (c_nationkey);
+CREATE INDEX partsupp_suppkey_idx ON partsupp (ps_suppkey);
+CREATE INDEX orders_custkey_idx ON orders (o_custkey);
+CREATE INDEX orders_orderdate_idx ON orders (o_orderdate);
+CREATE INDEX lineitem_partkey_idx ON lineitem (l_partkey);
+CREATE INDEX lineitem_suppkey_idx ON lineitem (l_suppkey);
+CREATE INDEX lineitem_shipdate_idx ON lineitem (l_shipdate);
+
+-- Substitution targets: wider variants of the indexes above.
+CREATE INDEX alt_orders_custkey ON orders (o_custkey, o_orderdate);
+CREATE INDEX alt_orders_orderdate ON orders (o_orderdate, o_custkey, o_totalprice);
+CREATE INDEX alt_lineitem_partkey ON lineitem (l_partkey, l_suppkey);
+CREATE INDEX alt_lineitem_suppkey ON lineitem (l_suppkey, l_partkey);
+CREATE INDEX alt_lineitem_shipdate ON lineitem (l_shipdate, l_discount, l_quantity);
+CREATE INDEX alt_customer_nationkey ON customer (c_nationkey, c_mktsegment);
+CREATE INDEX alt_partsupp_suppkey ON partsupp (ps_suppkey, ps_supplycost);
+
+ANALYZE;
+RESET search_path;
@@ -8,3 +8,278 @@ AS '$libdir/hypocost', 'hypocost_substitute_index';
 CREATE OR REPLACE FUNCTION hypocost_substitute_reset() RETURNS bool
 LANGUAGE C STRICT
 AS '$libdir/hypocost', 'hypocost_substitute_reset';
+
+CREATE OR REPLACE FUNCTION hypocost_costs(
+	query TEXT,
+	OUT node_id INT4,
+	OUT parent_id INT4,
+	OUT subplan INT4,
+	OUT node_type TEXT,
+	OUT relation TEXT,
+	OUT index_name TEXT,
+	OUT original_startup_cost FLOAT8,
+	OUT original_total_cost FLOAT8,
+	OUT original_rows FLOAT8,
+	OUT startup_cost FLOAT8,
+	OUT total_cost FLOAT8,
+	OUT rows FLOAT8
+) RETURNS SETOF record
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_costs';
+
+CREATE OR REPLACE FUNCTION hypocost_prepare(query TEXT) RETURNS INT4
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_prepare';
+
+CREATE OR REPLACE FUNCTION hypocost_prepared_costs(
+	handle INT4,
+	OUT node_id INT4,
+	OUT parent_id INT4,
+	OUT subplan INT4,
+	OUT node_type TEXT,
+	OUT relation TEXT,
+	OUT index_name TEXT,
+	OUT original_startup_cost FLOAT8,
+	OUT original_total_cost FLOAT8,
+	OUT original_rows FLOAT8,
+	OUT startup_cost FLOAT8,
+	OUT total_cost FLOAT8,
+	OUT rows FLOAT8
+) RETURNS SETOF record
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_prepared_costs';
+
+CREATE OR REPLACE FUNCTION hypocost_deallocate(handle INT4) RETURNS void
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_deallocate';
+
+CREATE OR REPLACE FUNCTION hypocost_sweep(
+	query TEXT,
+	seq_costs FLOAT8[],
+	random_costs FLOAT8[],
+	budget FLOAT8 DEFAULT NULL,
+	OUT config INT4,
+	OUT seq_page_cost FLOAT8,
+	OUT random_page_cost FLOAT8,
+	OUT startup_cost FLOAT8,
+	OUT total_cost FLOAT8,
+	OUT rows FLOAT8,
+	OUT pruned BOOL
+) RETURNS SETOF record
+LANGUAGE C
+AS '$libdir/hypocost', 'hypocost_sweep';
+
+CREATE OR REPLACE FUNCTION hypocost_candidates(
+	query TEXT,
+	OUT node_id INT4,
+	OUT relation TEXT,
+	OUT index_name TEXT,
+	OUT candidate_index TEXT,
+	OUT node_type TEXT,
+	OUT startup_cost FLOAT8,
+	OUT total_cost FLOAT8,
+	OUT rows FLOAT8,
+	OUT chosen BOOL
+) RETURNS SETOF record
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_candidates';
+
+CREATE OR REPLACE FUNCTION hypocost_regret(
+	query TEXT,
+	OUT preserved_cost FLOAT8,
+	OUT replanned_cost FLOAT8,
+	OUT regret FLOAT8,
+	OUT kind TEXT,
+	OUT relations TEXT,
+	OUT preserved TEXT,
+	OUT replanned TEXT
+) RETURNS SETOF record
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_regret';
+
+CREATE OR REPLACE FUNCTION hypocost_memory(
+	query TEXT,
+	OUT node_id INT4,
+	OUT parent_id INT4,
+	OUT subplan INT4,
+	OUT node_type TEXT,
+	OUT memory_limit FLOAT8,
+	OUT spills BOOL,
+	OUT batches FLOAT8
+) RETURNS SETOF record
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_memory';
+
+CREATE OR REPLACE FUNCTION hypocost_memoize(
+	query TEXT,
+	OUT node_id INT4,
+	OUT parent_id INT4,
+	OUT subplan INT4,
+	OUT calls FLOAT8,
+	OUT ndistinct FLOAT8,
+	OUT cache_entries FLOAT8,
+	OUT memory_limit FLOAT8,
+	OUT hit_ratio FLOAT8,
+	OUT evict_ratio FLOAT8,
+	OUT rescan_startup_cost FLOAT8,
+	OUT rescan_total_cost FLOAT8
+) RETURNS SETOF record
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_memoize';
+
+CREATE OR REPLACE FUNCTION hypocost_coefficients(
+	query TEXT,
+	OUT node_id INT4,
+	OUT parent_id INT4,
+	OUT subplan INT4,
+	OUT node_type TEXT,
+	OUT relation TEXT,
+	OUT constant_cost FLOAT8,
+	OUT seq_page_coef FLOAT8,
+	OUT random_page_coef FLOAT8,
+	OUT cpu_tuple_coef FLOAT8,
+	OUT cpu_index_tuple_coef FLOAT8,
+	OUT cpu_operator_coef FLOAT8,
+	OUT linear BOOL,
+	OUT nonlinear_reason TEXT
+) RETURNS SETOF record
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_coefficients';
+
+CREATE OR REPLACE FUNCTION hypocost_stats(
+	OUT dbid OID,
+	OUT queryid INT8,
+	OUT recosts INT8,
+	OUT first_pass_time FLOAT8,
+	OUT second_pass_time FLOAT8,
+	OUT recost_time FLOAT8,
+	OUT substitutions_attempted INT8,
+	OUT substitutions_succeeded INT8,
+	OUT substitutions_degraded INT8,
+	OUT unsupported_errors INT8,
+	OUT mem_allocated INT8
+) RETURNS SETOF record
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_stats';
+
+CREATE OR REPLACE VIEW pg_stat_hypocost AS
+	SELECT * FROM hypocost_stats();
+
+CREATE OR REPLACE FUNCTION hypocost_stat_reset() RETURNS void
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_stat_reset';
+
+REVOKE ALL ON FUNCTION hypocost_stat_reset() FROM PUBLIC;
+
+CREATE OR REPLACE FUNCTION hypocost_stat_info(OUT dealloc INT8)
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_stat_info';
+
+CREATE OR REPLACE VIEW pg_stat_hypocost_info AS
+	SELECT * FROM hypocost_stat_info();
+
+CREATE OR REPLACE FUNCTION hypocost_cache_reset() RETURNS void
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_cache_reset';
+
+REVOKE ALL ON FUNCTION hypocost_cache_reset() FROM PUBLIC;
+
+CREATE OR REPLACE FUNCTION hypocost_workload_submit(
+	workload REGCLASS,
+	configs REGCLASS,
+	output REGCLASS,
+	nworkers INT4 DEFAULT 4
+) RETURNS INT4
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_workload_submit';
+
+REVOKE ALL ON FUNCTION hypocost_workload_submit(REGCLASS, REGCLASS, REGCLASS, INT4) FROM PUBLIC;
+
+CREATE OR REPLACE FUNCTION hypocost_scale_relation(
+	relation REGCLASS,
+	pages FLOAT8 DEFAULT 1,
+	tuples FLOAT8 DEFAULT 1,
+	ndistinct FLOAT8 DEFAULT NULL
+) RETURNS void
+LANGUAGE C
+AS '$libdir/hypocost', 'hypocost_scale_relation';
+
+CREATE OR REPLACE FUNCTION hypocost_set_allvisfrac(relation REGCLASS, allvisfrac FLOAT8) RETURNS void
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_set_allvisfrac';
+
+CREATE OR REPLACE FUNCTION hypocost_set_correlation(index REGCLASS, correlation FLOAT8) RETURNS void
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_set_correlation';
+
+CREATE OR REPLACE FUNCTION hypocost_inject_rows(query TEXT, node_id INT4, rows FLOAT8) RETURNS void
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_inject_node_rows';
+
+CREATE OR REPLACE FUNCTION hypocost_inject_rows(relations REGCLASS[], rows FLOAT8) RETURNS void
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_inject_relation_rows';
+
+CREATE OR REPLACE FUNCTION hypocost_set_page_costs(
+	relation REGCLASS,
+	seq_page_cost FLOAT8 DEFAULT NULL,
+	random_page_cost FLOAT8 DEFAULT NULL
+) RETURNS void
+LANGUAGE C
+AS '$libdir/hypocost', 'hypocost_set_page_costs';
+
+CREATE OR REPLACE FUNCTION hypocost_set_tablespace_page_costs(
+	tablespace NAME,
+	seq_page_cost FLOAT8 DEFAULT NULL,
+	random_page_cost FLOAT8 DEFAULT NULL
+) RETURNS void
+LANGUAGE C
+AS '$libdir/hypocost', 'hypocost_set_tablespace_page_costs';
+
+CREATE OR REPLACE FUNCTION hypocost_set_gather_workers(query TEXT, node_id INT4, workers INT4) RETURNS void
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_set_gather_workers';
+
+CREATE OR REPLACE FUNCTION hypocost_whatif_reset() RETURNS void
+LANGUAGE C STRICT
+AS '$libdir/hypocost', 'hypocost_whatif_reset';
+
+CREATE TABLE hypocost_profiles (
+	name TEXT PRIMARY KEY,
+	seq_page_cost FLOAT8,
+	random_page_cost FLOAT8,
+	cpu_tuple_cost FLOAT8,
+	cpu_index_tuple_cost FLOAT8,
+	cpu_operator_cost FLOAT8,
+	parallel_setup_cost FLOAT8,
+	parallel_tuple_cost FLOAT8,
+	effective_cache_size TEXT,
+	work_mem TEXT,
+	hash_mem_multiplier FLOAT8
+);
+SELECT pg_catalog.pg_extension_config_dump('hypocost_profiles', '');
+
+CREATE OR REPLACE FUNCTION hypocost_profile_apply(profile TEXT, is_local BOOL DEFAULT false) RETURNS void
+LANGUAGE plpgsql STRICT
+AS $$
+DECLARE
+	p hypocost_profiles;
+BEGIN
+	SELECT * INTO p FROM hypocost_profiles WHERE name = profile;
+	IF NOT FOUND THEN
+		RAISE EXCEPTION 'hypocost profile "%" does not exist', profile;
+	END IF;
+
+	-- A NULL column means the target machine matches the live settings.
+	PERFORM set_config('hypocost.seq_page_cost', COALESCE(p.seq_page_cost::text, current_setting('seq_page_cost')), is_local);
+	PERFORM set_config('hypocost.random_page_cost', COALESCE(p.random_page_cost::text, current_setting('random_page_cost')), is_local);
+	PERFORM set_config('hypocost.cpu_tuple_cost', COALESCE(p.cpu_tuple_cost::text, '-1'), is_local);
+	PERFORM set_config('hypocost.cpu_index_tuple_cost', COALESCE(p.cpu_index_tuple_cost::text, '-1'), is_local);
+	PERFORM set_config('hypocost.cpu_operator_cost', COALESCE(p.cpu_operator_cost::text, '-1'), is_local);
+	PERFORM set_config('hypocost.parallel_setup_cost', COALESCE(p.parallel_setup_cost::text, '-1'), is_local);
+	PERFORM set_config('hypocost.parallel_tuple_cost', COALESCE(p.parallel_tuple_cost::text, '-1'), is_local);
+	PERFORM set_config('hypocost.effective_cache_size', COALESCE(p.effective_cache_size, '-1'), is_local);
+	PERFORM set_config('hypocost.work_mem', COALESCE(p.work_mem, '-1'), is_local);
+	PERFORM set_config('hypocost.hash_mem_multiplier', COALESCE(p.hash_mem_multiplier::text, '-1'), is_local);
+END;
+$$;
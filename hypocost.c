@@ -1,7 +1,10 @@
+#include <limits.h>
+
 #include "postgres.h"
 #include "fmgr.h"
 #include "utils/guc.h"
 #include "float.h"
+#include "postmaster/bgworker.h"
 #include "tcop/utility.h"
 
 #include "hypocost.h"
@@ -14,11 +17,67 @@ bool hypocost_enable = false;
 bool hypocost_alter_explain = false;
 bool hypocost_substitute = false;
 bool hypocost_inject_analyze = false;
+bool hypocost_single_pass = false;
+int hypocost_activation = HYPOCOST_ACTIVATE_ALWAYS;
+int hypocost_substitute_mode = HYPOCOST_SUBSTITUTE_FIRST;
 double hypocost_seq_page_cost = 1.0;
 double hypocost_random_page_cost = 4.0;
+int hypocost_work_mem = -1;
+double hypocost_hash_mem_multiplier = -1;
+double hypocost_cpu_tuple_cost = -1;
+double hypocost_cpu_index_tuple_cost = -1;
+double hypocost_cpu_operator_cost = -1;
+double hypocost_parallel_setup_cost = -1;
+double hypocost_parallel_tuple_cost = -1;
+int hypocost_effective_cache_size = -1;
+int hypocost_parallel_workers = -1;
+double hypocost_cost_budget = -1;
+int hypocost_stats_max = 1000;
 
 static ProcessUtility_hook_type prev_utility_hook = NULL;
 
+static const struct config_enum_entry activation_options[] = {
+	{"always", HYPOCOST_ACTIVATE_ALWAYS, false},
+	{"explain", HYPOCOST_ACTIVATE_EXPLAIN, false},
+	{"comment", HYPOCOST_ACTIVATE_COMMENT, false},
+	{NULL, 0, false}
+};
+
+static const struct config_enum_entry substitute_mode_options[] = {
+	{"first", HYPOCOST_SUBSTITUTE_FIRST, false},
+	{"cheapest", HYPOCOST_SUBSTITUTE_CHEAPEST, false},
+	{NULL, 0, false}
+};
+
+// Anything between -1 and the planner's own minimum would never reach the cost model as set.
+static bool
+check_work_mem(int* newval, void** extra, GucSource source)
+{
+	if (*newval == -1 || *newval >= 64)
+		return true;
+	GUC_check_errdetail("hypocost.work_mem must be -1 or at least 64kB.");
+	return false;
+}
+
+// Without workers the leader runs the partial plan alone, which the parallel divisor doesn't model.
+static bool
+check_parallel_workers(int* newval, void** extra, GucSource source)
+{
+	if (*newval != 0)
+		return true;
+	GUC_check_errdetail("hypocost.parallel_workers must be -1 or at least 1.");
+	return false;
+}
+
+static bool
+check_hash_mem_multiplier(double* newval, void** extra, GucSource source)
+{
+	if (*newval == -1 || *newval >= 1.0)
+		return true;
+	GUC_check_errdetail("hypocost.hash_mem_multiplier must be -1 or at least 1.0.");
+	return false;
+}
+
 static void
 hypocost_utility_hook(
 	PlannedStmt *pstmt,
@@ -97,6 +156,33 @@ void _PG_init(void) {
         DefineCustomBoolVariable("hypocost.alter_explain", "Alter the explain.", NULL, &hypocost_alter_explain, false, PGC_SUSET, 0, NULL, NULL, NULL);
         DefineCustomBoolVariable("hypocost.inject_analyze", "Attempt to inject into analyze.", NULL, &hypocost_inject_analyze, false, PGC_SUSET, 0, NULL, NULL, NULL);
         DefineCustomBoolVariable("hypocost.substitute", "Attempt to substitute.", NULL, &hypocost_substitute, false, PGC_SUSET, 0, NULL, NULL, NULL);
+        DefineCustomBoolVariable("hypocost.single_pass", "Recost the first planner pass in place instead of planning twice.", NULL, &hypocost_single_pass, false, PGC_SUSET, 0, NULL, NULL, NULL);
+        DefineCustomEnumVariable(
+                "hypocost.activation",
+                "Which statements Hypocost recosts.",
+                "always recosts every statement, explain only EXPLAIN, comment only statements carrying a /* hypocost */ comment.",
+                &hypocost_activation,
+                HYPOCOST_ACTIVATE_ALWAYS,
+                activation_options,
+                PGC_SUSET,
+                0,
+                NULL,
+                NULL,
+                NULL
+        );
+        DefineCustomEnumVariable(
+                "hypocost.substitute_mode",
+                "Which matching substitution rule a scan uses.",
+                "first uses the first rule registered, cheapest costs every matching rule and keeps the cheapest.",
+                &hypocost_substitute_mode,
+                HYPOCOST_SUBSTITUTE_FIRST,
+                substitute_mode_options,
+                PGC_SUSET,
+                0,
+                NULL,
+                NULL,
+                NULL
+        );
         DefineCustomRealVariable(
                 "hypocost.seq_page_cost", 
                 "Hypocost Seq Page Cost",
@@ -125,7 +211,165 @@ void _PG_init(void) {
                 NULL,
                 NULL
         );
+        DefineCustomRealVariable(
+                "hypocost.cpu_tuple_cost",
+                "cpu_tuple_cost used while recosting.",
+                "-1 keeps the live cpu_tuple_cost.",
+                &hypocost_cpu_tuple_cost,
+                -1,
+                -1,
+                DBL_MAX,
+                PGC_SUSET,
+                0,
+                NULL,
+                NULL,
+                NULL
+        );
+        DefineCustomRealVariable(
+                "hypocost.cpu_index_tuple_cost",
+                "cpu_index_tuple_cost used while recosting.",
+                "-1 keeps the live cpu_index_tuple_cost.",
+                &hypocost_cpu_index_tuple_cost,
+                -1,
+                -1,
+                DBL_MAX,
+                PGC_SUSET,
+                0,
+                NULL,
+                NULL,
+                NULL
+        );
+        DefineCustomRealVariable(
+                "hypocost.cpu_operator_cost",
+                "cpu_operator_cost used while recosting.",
+                "-1 keeps the live cpu_operator_cost.",
+                &hypocost_cpu_operator_cost,
+                -1,
+                -1,
+                DBL_MAX,
+                PGC_SUSET,
+                0,
+                NULL,
+                NULL,
+                NULL
+        );
+        DefineCustomRealVariable(
+                "hypocost.parallel_setup_cost",
+                "parallel_setup_cost used while recosting.",
+                "-1 keeps the live parallel_setup_cost.",
+                &hypocost_parallel_setup_cost,
+                -1,
+                -1,
+                DBL_MAX,
+                PGC_SUSET,
+                0,
+                NULL,
+                NULL,
+                NULL
+        );
+        DefineCustomRealVariable(
+                "hypocost.parallel_tuple_cost",
+                "parallel_tuple_cost used while recosting.",
+                "-1 keeps the live parallel_tuple_cost.",
+                &hypocost_parallel_tuple_cost,
+                -1,
+                -1,
+                DBL_MAX,
+                PGC_SUSET,
+                0,
+                NULL,
+                NULL,
+                NULL
+        );
+        DefineCustomIntVariable(
+                "hypocost.effective_cache_size",
+                "effective_cache_size used while recosting.",
+                "-1 keeps the live effective_cache_size.",
+                &hypocost_effective_cache_size,
+                -1,
+                -1,
+                INT_MAX,
+                PGC_SUSET,
+                GUC_UNIT_BLOCKS,
+                NULL,
+                NULL,
+                NULL
+        );
+        DefineCustomIntVariable(
+                "hypocost.parallel_workers",
+                "Number of workers every Gather and Gather Merge is recosted with.",
+                "-1 keeps the workers each was planned with.",
+                &hypocost_parallel_workers,
+                -1,
+                -1,
+                MAX_PARALLEL_WORKER_LIMIT,
+                PGC_SUSET,
+                0,
+                check_parallel_workers,
+                NULL,
+                NULL
+        );
+        DefineCustomIntVariable(
+                "hypocost.work_mem",
+                "work_mem used while recosting.",
+                "-1 keeps the live work_mem.",
+                &hypocost_work_mem,
+                -1,
+                -1,
+                MAX_KILOBYTES,
+                PGC_SUSET,
+                GUC_UNIT_KB,
+                check_work_mem,
+                NULL,
+                NULL
+        );
+        DefineCustomRealVariable(
+                "hypocost.hash_mem_multiplier",
+                "hash_mem_multiplier used while recosting.",
+                "-1 keeps the live hash_mem_multiplier.",
+                &hypocost_hash_mem_multiplier,
+                -1,
+                -1,
+                1000.0,
+                PGC_SUSET,
+                0,
+                check_hash_mem_multiplier,
+                NULL,
+                NULL
+        );
+        DefineCustomRealVariable(
+                "hypocost.cost_budget",
+                "Total cost past which hypocost_sweep stops recosting a configuration.",
+                "-1 disables the budget.",
+                &hypocost_cost_budget,
+                -1,
+                -1,
+                DBL_MAX,
+                PGC_SUSET,
+                0,
+                NULL,
+                NULL,
+                NULL
+        );
+        DefineCustomIntVariable(
+                "hypocost.stats_max",
+                "Number of statements tracked by pg_stat_hypocost.",
+                NULL,
+                &hypocost_stats_max,
+                1000,
+                100,
+                INT_MAX / 2,
+                PGC_POSTMASTER,
+                0,
+                NULL,
+                NULL,
+                NULL
+        );
+
 
+        hypocost_stats_init();
+        hypocost_cache_init();
+        hypocost_whatif_init();
 
         MarkGUCPrefixReserved("hypocost");
 
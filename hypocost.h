@@ -6,26 +6,245 @@
 #include "optimizer/planner.h"
 #include "commands/explain.h"
 #include "nodes/primnodes.h"
+#include "utils/hsearch.h"
+
+/** Which statements get recosted when hypocost.enable is on. */
+typedef enum HypocostActivation
+{
+	HYPOCOST_ACTIVATE_ALWAYS,
+	HYPOCOST_ACTIVATE_EXPLAIN,
+	HYPOCOST_ACTIVATE_COMMENT
+} HypocostActivation;
+
+/** Which matching substitution rule a scan uses. */
+typedef enum HypocostSubstituteMode
+{
+	HYPOCOST_SUBSTITUTE_FIRST,
+	HYPOCOST_SUBSTITUTE_CHEAPEST
+} HypocostSubstituteMode;
+
+/** An index path that could stand in for a scan under one substitution rule. */
+typedef struct HypocostCandidate
+{
+	IndexPath path;
+	// The rule only allowed turning an IndexOnlyScan into an IndexScan.
+	bool degraded;
+} HypocostCandidate;
+
+/** State of a first planner pass kept alive so it can be recosted in place. */
+struct HypocostCapture
+{
+	PlannedStmt* plan;
+	PlannerInfo* root;
+	Path* path;
+
+	// Snapshots taken before create_plan()/set_plan_references() scribble on them.
+	List* subplans;
+	List* subroots;
+	List* init_plans;
+	int nparamexec;
+	Bitmapset* rewind_plan_ids;
+
+	// The Query handed to standard_planner(); only its top-level root is captured.
+	Query* parse;
+	// Node-id overrides only apply to the statement they were given for.
+	char* query_string;
+};
+
+/**
+ * Callbacks invoked around every node a recost visits. Nodes are numbered in
+ * visiting order; plan_id is the subplan being recosted (0 for the main tree).
+ */
+typedef struct HypocostObserver
+{
+	void (*before)(int node_id, int parent_id, int plan_id, PlannerInfo* root, Path* path, void* context);
+	void (*after)(int node_id, PlannerInfo* root, Path* path, void* context);
+	// Every substitution candidate costed for a scan, before the chosen one is applied.
+	void (*candidate)(int node_id, PlannerInfo* root, IndexPath* ipath, HypocostCandidate* cand, bool chosen, void* context);
+	void* context;
+} HypocostObserver;
+
+/** Work hypocost did for one statement; accumulated into pg_stat_hypocost. */
+typedef struct HypocostCounters
+{
+	int64 recosts;
+	// Milliseconds.
+	double first_pass_time;
+	double second_pass_time;
+	double recost_time;
+	int64 subst_attempted;
+	int64 subst_succeeded;
+	// IndexOnlyScans that could only be substituted as an IndexScan.
+	int64 subst_degraded;
+	int64 unsupported;
+	// Bytes.
+	int64 mem_allocated;
+
+	// Only reported by EXPLAIN.
+	int64 match_lookups;
+	int64 fake_opt_builds;
+	int64 nodes_recosted[T_Limit + 1];
+} HypocostCounters;
+
+/** Costs of one node before and after a recost. */
+typedef struct NodeCost
+{
+	int node_id;
+	int parent_id;
+	int plan_id;
+	NodeTag pathtype;
+	Oid relid;
+	Oid indexoid;
+
+	Cost orig_startup;
+	Cost orig_total;
+	double orig_rows;
+
+	Cost startup;
+	Cost total;
+	double rows;
+} NodeCost;
+
+/** Outcome of recosting a statement under one configuration. */
+typedef struct HypocostResult
+{
+	// Root costs including init plans.
+	Cost startup;
+	Cost total;
+	double rows;
+
+	// The recost passed its budget; total is only a lower bound.
+	bool pruned;
+
+	int nnodes;
+	NodeCost* nodes;
+} HypocostResult;
+
+/**
+ * A captured statement kept for the rest of the session. Each recost only
+ * revisits the scans whose substitution rules changed and their ancestors.
+ */
+typedef struct HypocostPrepared
+{
+	int id;
+	char* query_string;
+	// Holds the capture and everything recosting it allocates.
+	MemoryContext cxt;
+	// Set when a relation the statement depends on was invalidated.
+	bool stale;
+
+	// Owned by hypocost_plan.c.
+	struct HypocostCapture* cap;
+	struct GUCState* guc;
+	int* valid_subplan_ids;
+	size_t valid_subplan_ids_len;
+	uint64 live_hash;
+	uint64 settings_hash;
+	bool recosted;
+	HTAB* nodes;
+	List* memo;
+} HypocostPrepared;
+
+/** Identifies a recost result shared between backends. */
+typedef struct HypocostCacheKey
+{
+	uint64 queryid;
+	uint64 query_hash;
+	uint64 settings_hash;
+	uint64 rules_hash;
+	Oid dbid;
+	Oid userid;
+} HypocostCacheKey;
 
 /** Hooks */
 void hypocost_explain(Query *query, int cursorOptions, IntoClause *into, ExplainState *es, const char *queryString, ParamListInfo params, QueryEnvironment *queryEnv);
 void hypocost_scribble(PlannerInfo* root, Path* path);
 SubPlan* hypocost_pick_altsubplan(PlannerInfo* root, List* subplans);
 PlannedStmt* hypocost_planner(Query *parse, const char* query_string, int cursorOptions, ParamListInfo boundParams);
+bool hypocost_activated(const char* query_string);
 
-void hypocost_check_substitute(PlannerInfo* root, IndexPath* ipath, Path* outer);
+/** Recosting without building plans */
+struct HypocostCapture* hypocost_capture(Query* parse, const char* query_string, int cursorOptions, ParamListInfo boundParams);
+void hypocost_recost(struct HypocostCapture* cap, HypocostObserver* observer);
+bool hypocost_recost_bounded(struct HypocostCapture* cap, HypocostObserver* observer, double budget, Cost* bound);
+void hypocost_release(void);
+void hypocost_undo_substitutions(void);
+PlannedStmt* hypocost_plan_unconstrained(Query* parse, const char* query_string, int cursorOptions);
+void hypocost_prepared_capture(HypocostPrepared* prep);
+HypocostResult* hypocost_recost_prepared(HypocostPrepared* prep);
+HypocostPrepared* hypocost_prepared_lookup(int id);
+Oid hypocost_path_relid(PlannerInfo* root, Path* path);
+const char* hypocost_pathtype_name(Path* path);
+const char* hypocost_plantype_name(NodeTag tag);
+const char* hypocost_index_name(Oid indexoid);
+Query* hypocost_parse_query(const char* query_string);
+
+List* hypocost_substitute_candidates(PlannerInfo* root, IndexPath* ipath, Path* outer, bool all);
 List* hypocost_check_replace(PlannerInfo* root, Path* path, bool inc_pk);
 void hypocost_substitute_bpath(PlannerInfo* root, Path* path, List* oids);
+uint32 hypocost_match_signature(Oid indexoid);
+void hypocost_end_cycle(void);
+Tuplestorestate* hypocost_init_srf(FunctionCallInfo fcinfo, TupleDesc* tupdesc);
+
+/** Shared result cache */
+void hypocost_cache_init(void);
+bool hypocost_cache_key(Query* query, const char* query_string, HypocostCacheKey* key);
+HypocostResult* hypocost_cache_lookup(HypocostCacheKey* key, const char* query_string);
+void hypocost_cache_store(HypocostCacheKey* key, const char* query_string, List* relids, HypocostResult* result);
+uint64 hypocost_settings_hash(void);
+uint64 hypocost_rules_hash(void);
+bool hypocost_rules_active(void);
+bool hypocost_hypothetical_indexes(void);
+
+/** What-if overrides */
+void hypocost_whatif_init(void);
+void hypocost_whatif_apply(PlannerInfo* root, const char* query_string);
+void hypocost_whatif_restore(void);
+void hypocost_whatif_save(double* field);
+void hypocost_whatif_save_workers(int* field);
+void hypocost_whatif_restore_workers(void);
+void hypocost_whatif_reset_selectivity(List* rinfos);
+bool hypocost_whatif_rows_changed(void);
+void hypocost_whatif_apply_rebuilt(PlannerInfo* root, RelOptInfo* rel);
+void hypocost_whatif_inject_rows(PlannerInfo* root, RelOptInfo* rel);
+void hypocost_whatif_node_rows(int node_id, Path* path);
+bool hypocost_whatif_has_node_rows(const char* query_string);
+bool hypocost_whatif_page_costs(PlannerInfo* root, RelOptInfo* rel, double* seq, double* random);
+bool hypocost_whatif_gather_workers(int node_id, int* workers);
+uint64 hypocost_whatif_hash(void);
+bool hypocost_whatif_active(void);
+
+/** Statistics */
+void hypocost_stats_init(void);
+void hypocost_stats_begin(uint64 queryid);
+void hypocost_stats_flush(void);
 
 extern bool hypocost_enable;
 extern bool hypocost_alter_explain;
 extern bool hypocost_inject_analyze;
 extern bool hypocost_substitute;
 extern bool hypocost_in_explain_analyze;
+extern bool hypocost_in_explain;
 extern bool hypocost_do_scribble;
+extern bool hypocost_single_pass;
+extern int hypocost_activation;
+extern int hypocost_substitute_mode;
+extern int hypocost_stats_max;
+extern int hypocost_cache_size;
+extern HypocostCounters hypocost_counters;
 
+extern double hypocost_cost_budget;
 extern double hypocost_seq_page_cost;
 extern double hypocost_random_page_cost;
+extern int hypocost_work_mem;
+extern double hypocost_hash_mem_multiplier;
+extern double hypocost_cpu_tuple_cost;
+extern double hypocost_cpu_index_tuple_cost;
+extern double hypocost_cpu_operator_cost;
+extern double hypocost_parallel_setup_cost;
+extern double hypocost_parallel_tuple_cost;
+extern int hypocost_effective_cache_size;
+extern int hypocost_parallel_workers;
 
 struct PartialExplainContext
 {
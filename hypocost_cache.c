@@ -0,0 +1,403 @@
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "common/hashfn.h"
+#include "lib/dshash.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/dsa.h"
+#include "utils/guc.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+
+#include "hypocost.h"
+
+PG_FUNCTION_INFO_V1(hypocost_cache_reset);
+
+/*
+ * Recost results shared by all backends. Entries live in a dshash over a DSA
+ * that starts out in the main shared memory segment, the same way the
+ * cumulative statistics system sets up its shared hash.
+ */
+
+// Initial DSA size; it grows into DSM segments up to hypocost.cache_size.
+#define CACHE_DSA_INIT_SIZE (256 * 1024)
+
+// Relation generations are kept in buckets; a collision only costs a cache miss.
+#define NUM_REL_GENERATIONS 1024
+
+#define REL_GENERATION(relid) (&cache_shared->rel_generations[(relid) % NUM_REL_GENERATIONS])
+
+/*
+ * Invalidations bump shared generation counters in whichever backend
+ * processes them first, and every lookup processes pending invalidations
+ * before checking an entry against the counters it was stored under. So no
+ * backend can read an entry that predates a committed change.
+ */
+typedef struct CacheShared
+{
+	int dsa_tranche;
+	int hash_tranche;
+	dshash_table_handle hash_handle;
+	// Bumped by every invalidation; a recost that saw it change is not stored.
+	pg_atomic_uint64 generation;
+	// Bumped by invalidations that can't be traced to a relation.
+	pg_atomic_uint64 all_generation;
+	pg_atomic_uint64 rel_generations[NUM_REL_GENERATIONS];
+	// The DSA control data follows.
+	char raw_dsa_area[FLEXIBLE_ARRAY_MEMBER];
+} CacheShared;
+
+typedef struct CacheEntry
+{
+	HypocostCacheKey key;
+	dsa_pointer data;
+} CacheEntry;
+
+/*
+ * Layout of an entry's data: header, relation OIDs, their generations, the
+ * nodes, then the query text.
+ */
+typedef struct CacheData
+{
+	Cost startup;
+	Cost total;
+	double rows;
+	uint64 all_generation;
+	int nrelids;
+	int nnodes;
+	int query_len;
+} CacheData;
+
+#define CACHE_RELIDS_OFFSET MAXALIGN(sizeof(CacheData))
+#define CACHE_GENERATIONS_OFFSET(nrelids) (CACHE_RELIDS_OFFSET + MAXALIGN(sizeof(Oid) * (nrelids)))
+#define CACHE_NODES_OFFSET(nrelids) (CACHE_GENERATIONS_OFFSET(nrelids) + sizeof(uint64) * (nrelids))
+#define CACHE_QUERY_OFFSET(nrelids, nnodes) (CACHE_NODES_OFFSET(nrelids) + sizeof(NodeCost) * (nnodes))
+
+int hypocost_cache_size = 16;
+
+static CacheShared* cache_shared = NULL;
+static dsa_area* cache_dsa = NULL;
+static dshash_table* cache_hash = NULL;
+
+// The generation when this backend last looked up the cache.
+static uint64 lookup_generation = 0;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static dshash_parameters cache_hash_params = {
+	sizeof(HypocostCacheKey),
+	sizeof(CacheEntry),
+	dshash_memcmp,
+	dshash_memhash,
+	0
+};
+
+static Size
+cache_memsize(void)
+{
+	return add_size(offsetof(CacheShared, raw_dsa_area), CACHE_DSA_INIT_SIZE);
+}
+
+static void
+cache_shmem_request(void)
+{
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+
+	RequestAddinShmemSpace(cache_memsize());
+}
+
+static void
+cache_shmem_startup(void)
+{
+	bool found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	cache_shared = ShmemInitStruct("hypocost cache", cache_memsize(), &found);
+	if (!found)
+	{
+		dsa_area* dsa;
+		dshash_table* hash;
+		int i;
+
+		cache_shared->dsa_tranche = LWLockNewTrancheId();
+		cache_shared->hash_tranche = LWLockNewTrancheId();
+		pg_atomic_init_u64(&cache_shared->generation, 0);
+		pg_atomic_init_u64(&cache_shared->all_generation, 0);
+		for (i = 0; i < NUM_REL_GENERATIONS; i++)
+			pg_atomic_init_u64(&cache_shared->rel_generations[i], 0);
+
+		// Keep the hash itself in the main segment so nothing needs a DSM segment yet.
+		dsa = dsa_create_in_place(cache_shared->raw_dsa_area, CACHE_DSA_INIT_SIZE, cache_shared->dsa_tranche, NULL);
+		dsa_pin(dsa);
+		dsa_set_size_limit(dsa, CACHE_DSA_INIT_SIZE);
+
+		cache_hash_params.tranche_id = cache_shared->hash_tranche;
+		hash = dshash_create(dsa, &cache_hash_params, NULL);
+		cache_shared->hash_handle = dshash_get_hash_table_handle(hash);
+
+		dsa_set_size_limit(dsa, (size_t) hypocost_cache_size * 1024 * 1024);
+		dshash_detach(hash);
+		dsa_detach(dsa);
+	}
+	LWLockRelease(AddinShmemInitLock);
+}
+
+static void
+cache_relcache_callback(Datum arg, Oid relid)
+{
+	if (cache_shared == NULL)
+		return;
+
+	if (OidIsValid(relid))
+		pg_atomic_fetch_add_u64(REL_GENERATION(relid), 1);
+	else
+		pg_atomic_fetch_add_u64(&cache_shared->all_generation, 1);
+	pg_atomic_fetch_add_u64(&cache_shared->generation, 1);
+}
+
+static void
+cache_statistic_callback(Datum arg, int cacheid, uint32 hashvalue)
+{
+	if (cache_shared == NULL)
+		return;
+
+	// ANALYZE does not always touch pg_class; new statistics can't be traced to a relation.
+	pg_atomic_fetch_add_u64(&cache_shared->all_generation, 1);
+	pg_atomic_fetch_add_u64(&cache_shared->generation, 1);
+}
+
+void
+hypocost_cache_init(void)
+{
+	DefineCustomIntVariable(
+		"hypocost.cache_size",
+		"Shared memory for cached recost results, in megabytes (0 disables the cache).",
+		NULL,
+		&hypocost_cache_size,
+		16,
+		0,
+		MAX_KILOBYTES / 1024,
+		PGC_POSTMASTER,
+		GUC_UNIT_MB,
+		NULL,
+		NULL,
+		NULL
+	);
+
+	if (!process_shared_preload_libraries_in_progress || hypocost_cache_size == 0)
+		return;
+
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = cache_shmem_request;
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = cache_shmem_startup;
+
+	CacheRegisterRelcacheCallback(cache_relcache_callback, (Datum) 0);
+	CacheRegisterSyscacheCallback(STATRELATTINH, cache_statistic_callback, (Datum) 0);
+}
+
+static bool
+cache_attach(void)
+{
+	MemoryContext oldcontext;
+
+	if (cache_hash != NULL)
+		return true;
+	if (cache_shared == NULL)
+		return false;
+
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	cache_dsa = dsa_attach_in_place(cache_shared->raw_dsa_area, NULL);
+	dsa_pin_mapping(cache_dsa);
+	cache_hash_params.tranche_id = cache_shared->hash_tranche;
+	cache_hash = dshash_attach(cache_dsa, &cache_hash_params, cache_shared->hash_handle, NULL);
+	MemoryContextSwitchTo(oldcontext);
+	return true;
+}
+
+// Whether a relation the entry depends on was invalidated since it was stored.
+static bool
+entry_stale(CacheData* data)
+{
+	Oid* relids = (Oid*)((char*)data + CACHE_RELIDS_OFFSET);
+	uint64* generations = (uint64*)((char*)data + CACHE_GENERATIONS_OFFSET(data->nrelids));
+	int i;
+
+	if (data->all_generation != pg_atomic_read_u64(&cache_shared->all_generation))
+		return true;
+
+	for (i = 0; i < data->nrelids; i++)
+	{
+		if (generations[i] != pg_atomic_read_u64(REL_GENERATION(relids[i])))
+			return true;
+	}
+	return false;
+}
+
+static void
+remove_entries(void)
+{
+	dshash_seq_status status;
+	CacheEntry* entry;
+
+	dshash_seq_init(&status, cache_hash, true);
+	while ((entry = dshash_seq_next(&status)) != NULL)
+	{
+		dsa_free(cache_dsa, entry->data);
+		dshash_delete_current(&status);
+	}
+	dshash_seq_term(&status);
+}
+
+bool
+hypocost_cache_key(Query* query, const char* query_string, HypocostCacheKey* key)
+{
+	if (hypocost_cache_size == 0 || cache_shared == NULL)
+		return false;
+
+	// Without a fingerprint the statement can't be told apart from others.
+	if (query->queryId == UINT64CONST(0))
+		return false;
+
+	// Another backend's hypothetical indexes are not ours, even under the same OID.
+	if (hypocost_hypothetical_indexes())
+		return false;
+
+	// Zero the padding since the key is hashed as a blob.
+	memset(key, 0x00, sizeof(HypocostCacheKey));
+	key->queryid = query->queryId;
+	key->dbid = MyDatabaseId;
+	// Row security and permissions can make the same text plan differently per role.
+	key->userid = GetUserId();
+	// The fingerprint ignores constants; the text itself is compared on lookup.
+	key->query_hash = hash_bytes_extended((const unsigned char*)query_string, strlen(query_string), 0);
+	key->settings_hash = hypocost_settings_hash();
+	key->rules_hash = hypocost_rules_hash();
+	return true;
+}
+
+HypocostResult*
+hypocost_cache_lookup(HypocostCacheKey* key, const char* query_string)
+{
+	CacheEntry* entry;
+	CacheData* data;
+	HypocostResult* result = NULL;
+
+	if (!cache_attach())
+		return NULL;
+
+	// Committed changes this backend hasn't seen yet bump the counters here.
+	AcceptInvalidationMessages();
+
+	// Taken before planning so that a change made while recosting keeps the result out.
+	lookup_generation = pg_atomic_read_u64(&cache_shared->generation);
+	pg_read_barrier();
+
+	entry = dshash_find(cache_hash, key, true);
+	if (entry == NULL)
+		return NULL;
+
+	data = (CacheData*)dsa_get_address(cache_dsa, entry->data);
+	if (entry_stale(data))
+	{
+		dsa_free(cache_dsa, entry->data);
+		dshash_delete_entry(cache_hash, entry);
+		return NULL;
+	}
+
+	if (data->query_len == (int) strlen(query_string) &&
+	    memcmp((char*)data + CACHE_QUERY_OFFSET(data->nrelids, data->nnodes), query_string, data->query_len) == 0)
+	{
+		result = palloc0(sizeof(HypocostResult));
+		result->startup = data->startup;
+		result->total = data->total;
+		result->rows = data->rows;
+		result->nnodes = data->nnodes;
+		result->nodes = palloc(sizeof(NodeCost) * Max(data->nnodes, 1));
+		memcpy(result->nodes, (char*)data + CACHE_NODES_OFFSET(data->nrelids), sizeof(NodeCost) * data->nnodes);
+	}
+	dshash_release_lock(cache_hash, entry);
+	return result;
+}
+
+void
+hypocost_cache_store(HypocostCacheKey* key, const char* query_string, List* relids, HypocostResult* result)
+{
+	int query_len = strlen(query_string);
+	Size size = CACHE_QUERY_OFFSET(list_length(relids), result->nnodes) + query_len;
+	dsa_pointer dp;
+	CacheData* data;
+	Oid* datarelids;
+	uint64* generations;
+	uint64 all_generation;
+	CacheEntry* entry;
+	ListCell* lc;
+	bool found;
+
+	if (!cache_attach())
+		return;
+
+	dp = dsa_allocate_extended(cache_dsa, size, DSA_ALLOC_NO_OOM);
+	if (!DsaPointerIsValid(dp))
+	{
+		// Full; start over rather than tracking recency.
+		remove_entries();
+		dp = dsa_allocate_extended(cache_dsa, size, DSA_ALLOC_NO_OOM);
+		if (!DsaPointerIsValid(dp))
+			return;
+	}
+
+	data = (CacheData*)dsa_get_address(cache_dsa, dp);
+	data->startup = result->startup;
+	data->total = result->total;
+	data->rows = result->rows;
+	data->nrelids = list_length(relids);
+	data->nnodes = result->nnodes;
+	data->query_len = query_len;
+	datarelids = (Oid*)((char*)data + CACHE_RELIDS_OFFSET);
+	generations = (uint64*)((char*)data + CACHE_GENERATIONS_OFFSET(data->nrelids));
+	all_generation = pg_atomic_read_u64(&cache_shared->all_generation);
+	foreach(lc, relids)
+	{
+		datarelids[foreach_current_index(lc)] = lfirst_oid(lc);
+		generations[foreach_current_index(lc)] = pg_atomic_read_u64(REL_GENERATION(lfirst_oid(lc)));
+	}
+	data->all_generation = all_generation;
+	memcpy((char*)data + CACHE_NODES_OFFSET(data->nrelids), result->nodes, sizeof(NodeCost) * result->nnodes);
+	memcpy((char*)data + CACHE_QUERY_OFFSET(data->nrelids, data->nnodes), query_string, query_len);
+
+	// Anything invalidated since the lookup may have raced with the recost.
+	pg_read_barrier();
+	if (pg_atomic_read_u64(&cache_shared->generation) != lookup_generation)
+	{
+		dsa_free(cache_dsa, dp);
+		return;
+	}
+
+	entry = dshash_find_or_insert(cache_hash, key, &found);
+	if (found)
+		dsa_free(cache_dsa, entry->data);
+	entry->data = dp;
+	dshash_release_lock(cache_hash, entry);
+}
+
+Datum
+hypocost_cache_reset(PG_FUNCTION_ARGS)
+{
+	if (!cache_attach())
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("the hypocost cache requires hypocost in shared_preload_libraries and hypocost.cache_size > 0")));
+
+	remove_entries();
+	PG_RETURN_VOID();
+}
@@ -0,0 +1,1346 @@
+#include <math.h>
+
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "access/htup_details.h"
+#include "executor/nodeAgg.h"
+#include "executor/nodeHash.h"
+#include "executor/nodeMemoize.h"
+#include "lib/stringinfo.h"
+#include "nodes/nodeFuncs.h"
+#include "nodes/pathnodes.h"
+#include "optimizer/cost.h"
+#include "optimizer/optimizer.h"
+#include "parser/parsetree.h"
+#include "catalog/pg_type.h"
+#include "tcop/tcopprot.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/selfuncs.h"
+#include "utils/tuplestore.h"
+
+#include "hypocost.h"
+
+PG_FUNCTION_INFO_V1(hypocost_costs);
+PG_FUNCTION_INFO_V1(hypocost_prepared_costs);
+PG_FUNCTION_INFO_V1(hypocost_sweep);
+PG_FUNCTION_INFO_V1(hypocost_coefficients);
+PG_FUNCTION_INFO_V1(hypocost_candidates);
+PG_FUNCTION_INFO_V1(hypocost_regret);
+PG_FUNCTION_INFO_V1(hypocost_memory);
+PG_FUNCTION_INFO_V1(hypocost_memoize);
+
+typedef struct CostsContext
+{
+	List* nodes;
+} CostsContext;
+
+
+Query*
+hypocost_parse_query(const char* query_string)
+{
+	List* raw_parsetree_list;
+	List* querytree_list;
+	Query* query;
+
+	raw_parsetree_list = pg_parse_query(query_string);
+	if (list_length(raw_parsetree_list) != 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("hypocost can only recost a single statement")));
+
+	querytree_list = pg_analyze_and_rewrite_fixedparams(linitial_node(RawStmt, raw_parsetree_list), query_string, NULL, 0, NULL);
+	if (list_length(querytree_list) != 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("hypocost cannot recost a statement that rewrites into multiple queries")));
+
+	query = linitial_node(Query, querytree_list);
+	if (query->commandType == CMD_UTILITY)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("hypocost cannot recost utility statements")));
+	return query;
+}
+
+
+Oid
+hypocost_path_relid(PlannerInfo* root, Path* path)
+{
+	RelOptInfo* rel = path->parent;
+	if (rel != NULL && rel->relid > 0 &&
+	    (rel->reloptkind == RELOPT_BASEREL || rel->reloptkind == RELOPT_OTHER_MEMBER_REL))
+	{
+		RangeTblEntry* rte = planner_rt_fetch(rel->relid, root);
+		if (rte->rtekind == RTE_RELATION)
+			return rte->relid;
+	}
+	return InvalidOid;
+}
+
+static void
+costs_before(int node_id, int parent_id, int plan_id, PlannerInfo* root, Path* path, void* context)
+{
+	CostsContext* ctx = (CostsContext*)context;
+	NodeCost* nc = palloc0(sizeof(NodeCost));
+	nc->node_id = node_id;
+	nc->parent_id = parent_id;
+	nc->plan_id = plan_id;
+	nc->pathtype = path->pathtype;
+	nc->relid = hypocost_path_relid(root, path);
+	nc->orig_startup = path->startup_cost;
+	nc->orig_total = path->total_cost;
+	nc->orig_rows = path->rows;
+
+	Assert(list_length(ctx->nodes) == node_id);
+	ctx->nodes = lappend(ctx->nodes, nc);
+}
+
+static void
+costs_after(int node_id, PlannerInfo* root, Path* path, void* context)
+{
+	CostsContext* ctx = (CostsContext*)context;
+	NodeCost* nc = list_nth(ctx->nodes, node_id);
+	nc->startup = path->startup_cost;
+	nc->total = path->total_cost;
+	nc->rows = path->rows;
+
+	// Report the index the scan ended up with (after any substitution).
+	if (IsA(path, IndexPath))
+		nc->indexoid = ((IndexPath*)path)->indexinfo->indexoid;
+}
+
+// Recost the captured tree under the current settings, keeping every node unless pruned by budget.
+static HypocostResult*
+recost_result(struct HypocostCapture* cap, double budget)
+{
+	HypocostResult* result = palloc0(sizeof(HypocostResult));
+	CostsContext ctx = { .nodes = NIL };
+	HypocostObserver observer = {
+		.before = costs_before,
+		.after = costs_after,
+		.context = &ctx
+	};
+	ListCell* lc;
+
+	if (hypocost_recost_bounded(cap, &observer, budget, &result->total))
+	{
+		result->pruned = true;
+		return result;
+	}
+
+	result->startup = cap->path->startup_cost;
+	result->total = cap->path->total_cost;
+	result->rows = cap->path->rows;
+	result->nnodes = list_length(ctx.nodes);
+	result->nodes = palloc(sizeof(NodeCost) * Max(result->nnodes, 1));
+	foreach(lc, ctx.nodes)
+		result->nodes[foreach_current_index(lc)] = *(NodeCost*)lfirst(lc);
+	return result;
+}
+
+static HypocostResult*
+collect_costs(const char* query_string)
+{
+	Query* query = hypocost_parse_query(query_string);
+	HypocostResult* result = NULL;
+	HypocostCacheKey key;
+	bool cacheable = hypocost_cache_key(query, query_string, &key);
+	struct HypocostCapture* cap;
+
+	if (cacheable && (result = hypocost_cache_lookup(&key, query_string)) != NULL)
+		return result;
+
+	cap = hypocost_capture(query, query_string, CURSOR_OPT_PARALLEL_OK, NULL);
+	PG_TRY();
+	{
+		result = recost_result(cap, -1);
+	}
+	PG_FINALLY();
+	{
+		hypocost_release();
+	}
+	PG_END_TRY();
+
+	if (cacheable)
+		hypocost_cache_store(&key, query_string, cap->plan->relationOids, result);
+	return result;
+}
+
+
+Tuplestorestate*
+hypocost_init_srf(FunctionCallInfo fcinfo, TupleDesc* tupdesc)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+	if (get_call_result_type(fcinfo, NULL, tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = *tupdesc;
+	MemoryContextSwitchTo(oldcontext);
+	return tupstore;
+}
+
+
+static void
+put_costs(Tuplestorestate* tupstore, TupleDesc tupdesc, HypocostResult* result)
+{
+	int i;
+
+	for (i = 0; i < result->nnodes; i++)
+	{
+		NodeCost* nc = &result->nodes[i];
+		Datum values[12];
+		bool nulls[12];
+		const char* relname = OidIsValid(nc->relid) ? get_rel_name(nc->relid) : NULL;
+		const char* indexname = OidIsValid(nc->indexoid) ? hypocost_index_name(nc->indexoid) : NULL;
+
+		memset(nulls, 0, sizeof(nulls));
+		values[0] = Int32GetDatum(nc->node_id);
+		values[1] = Int32GetDatum(nc->parent_id);
+		nulls[1] = nc->parent_id < 0;
+		values[2] = Int32GetDatum(nc->plan_id);
+		values[3] = CStringGetTextDatum(hypocost_plantype_name(nc->pathtype));
+		if (relname)
+			values[4] = CStringGetTextDatum(relname);
+		else
+			nulls[4] = true;
+		if (indexname)
+			values[5] = CStringGetTextDatum(indexname);
+		else
+			nulls[5] = true;
+		values[6] = Float8GetDatum(nc->orig_startup);
+		values[7] = Float8GetDatum(nc->orig_total);
+		values[8] = Float8GetDatum(nc->orig_rows);
+		values[9] = Float8GetDatum(nc->startup);
+		values[10] = Float8GetDatum(nc->total);
+		values[11] = Float8GetDatum(nc->rows);
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+}
+
+
+Datum
+hypocost_costs(PG_FUNCTION_ARGS)
+{
+	char* query_string = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	Tuplestorestate *tupstore;
+	TupleDesc tupdesc;
+
+	tupstore = hypocost_init_srf(fcinfo, &tupdesc);
+	put_costs(tupstore, tupdesc, collect_costs(query_string));
+	return (Datum) 0;
+}
+
+
+Datum
+hypocost_prepared_costs(PG_FUNCTION_ARGS)
+{
+	HypocostPrepared* prep = hypocost_prepared_lookup(PG_GETARG_INT32(0));
+	Tuplestorestate *tupstore;
+	TupleDesc tupdesc;
+
+	tupstore = hypocost_init_srf(fcinfo, &tupdesc);
+	put_costs(tupstore, tupdesc, hypocost_recost_prepared(prep));
+	return (Datum) 0;
+}
+
+
+static double*
+float8_array_values(ArrayType* array, int* count)
+{
+	Datum* elems;
+	bool* nulls;
+	double* values;
+	int i;
+
+	deconstruct_array(array, FLOAT8OID, sizeof(float8), FLOAT8PASSBYVAL, TYPALIGN_DOUBLE, &elems, &nulls, count);
+	values = palloc(sizeof(double) * Max(*count, 1));
+	for (i = 0; i < *count; i++)
+	{
+		if (nulls[i])
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					 errmsg("page cost arrays cannot contain NULL")));
+		values[i] = DatumGetFloat8(elems[i]);
+	}
+	return values;
+}
+
+Datum
+hypocost_sweep(PG_FUNCTION_ARGS)
+{
+	char* query_string;
+	double old_seq_page_cost = hypocost_seq_page_cost;
+	double old_random_page_cost = hypocost_random_page_cost;
+	double budget = PG_ARGISNULL(3) ? hypocost_cost_budget : PG_GETARG_FLOAT8(3);
+	Tuplestorestate *tupstore;
+	TupleDesc tupdesc;
+	double* seq_costs;
+	double* random_costs;
+	int nseq;
+	int nrandom;
+	int i;
+	Query* query;
+	HypocostCacheKey* keys;
+	bool* cacheable;
+	HypocostResult** results;
+	bool missing = false;
+
+	tupstore = hypocost_init_srf(fcinfo, &tupdesc);
+	// Not strict so that the budget can be left NULL.
+	if (PG_ARGISNULL(0) || PG_ARGISNULL(1) || PG_ARGISNULL(2))
+		return (Datum) 0;
+
+	query_string = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	seq_costs = float8_array_values(PG_GETARG_ARRAYTYPE_P(1), &nseq);
+	random_costs = float8_array_values(PG_GETARG_ARRAYTYPE_P(2), &nrandom);
+	if (nseq != nrandom)
+		ereport(ERROR,
+				(errcode(ERRCODE_ARRAY_SUBSCRIPT_ERROR),
+				 errmsg("seq_costs and random_costs must have the same length")));
+
+	query = hypocost_parse_query(query_string);
+	keys = palloc(sizeof(HypocostCacheKey) * Max(nseq, 1));
+	cacheable = palloc(sizeof(bool) * Max(nseq, 1));
+	results = palloc0(sizeof(HypocostResult*) * Max(nseq, 1));
+	PG_TRY();
+	{
+		// Answer what we can from the cache first.
+		for (i = 0; i < nseq; i++)
+		{
+			hypocost_seq_page_cost = seq_costs[i];
+			hypocost_random_page_cost = random_costs[i];
+			cacheable[i] = hypocost_cache_key(query, query_string, &keys[i]);
+			if (cacheable[i])
+				results[i] = hypocost_cache_lookup(&keys[i], query_string);
+			missing = missing || results[i] == NULL;
+		}
+
+		if (missing)
+		{
+			// Plan once and recost the same path tree under every remaining configuration.
+			struct HypocostCapture* cap = hypocost_capture(query, query_string, CURSOR_OPT_PARALLEL_OK, NULL);
+			PG_TRY();
+			{
+				for (i = 0; i < nseq; i++)
+				{
+					if (results[i] != NULL)
+						continue;
+
+					CHECK_FOR_INTERRUPTS();
+					hypocost_seq_page_cost = seq_costs[i];
+					hypocost_random_page_cost = random_costs[i];
+					// Each configuration picks its own substitutions, as hypocost_costs would.
+					hypocost_undo_substitutions();
+					results[i] = recost_result(cap, budget);
+					if (cacheable[i] && !results[i]->pruned)
+						hypocost_cache_store(&keys[i], query_string, cap->plan->relationOids, results[i]);
+				}
+			}
+			PG_FINALLY();
+			{
+				hypocost_release();
+			}
+			PG_END_TRY();
+		}
+	}
+	PG_FINALLY();
+	{
+		hypocost_seq_page_cost = old_seq_page_cost;
+		hypocost_random_page_cost = old_random_page_cost;
+	}
+	PG_END_TRY();
+
+	for (i = 0; i < nseq; i++)
+	{
+		Datum values[7];
+		bool nulls[7];
+
+		memset(nulls, 0, sizeof(nulls));
+		values[0] = Int32GetDatum(i + 1);
+		values[1] = Float8GetDatum(seq_costs[i]);
+		values[2] = Float8GetDatum(random_costs[i]);
+		values[3] = Float8GetDatum(results[i]->startup);
+		values[4] = Float8GetDatum(results[i]->total);
+		values[5] = Float8GetDatum(results[i]->rows);
+		values[6] = BoolGetDatum(results[i]->pruned);
+		// A pruned configuration only has a lower bound on its total cost.
+		nulls[3] = results[i]->pruned;
+		nulls[5] = results[i]->pruned;
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	return (Datum) 0;
+}
+
+
+/*
+ * Cost parameters that total cost is (close to) linear in for a fixed shape
+ * and fixed cardinalities. The page costs are the hypothetical ones; the CPU
+ * costs are the hypocost.* ones where set, otherwise the live planner settings.
+ */
+#define NUM_COEFFICIENTS 5
+#define NUM_EVALUATIONS (1 + 2 * NUM_COEFFICIENTS)
+
+typedef struct CoefNode
+{
+	int node_id;
+	int parent_id;
+	int plan_id;
+	const char* node_type;
+	Oid relid;
+	double totals[NUM_EVALUATIONS];
+	double constant;
+	double coefs[NUM_COEFFICIENTS];
+	const char* reason;
+	bool linear;
+	bool propagated;
+
+	// Subplans whose per-call cost this node pays.
+	List* subplan_ids;
+} CoefNode;
+
+typedef struct CoefContext
+{
+	List* nodes;
+	int evaluation;
+	int visited;
+} CoefContext;
+
+static const char*
+nonlinear_reason(Path* path)
+{
+	switch (path->pathtype)
+	{
+		case T_Sort:
+		{
+			Path* subpath = ((SortPath*)path)->subpath;
+			double bytes = subpath->rows * (MAXALIGN(subpath->pathtarget->width) + MAXALIGN(SizeofHeapTupleHeader));
+			if (bytes > work_mem * 1024.0)
+				return "sort spill";
+			break;
+		}
+		case T_IncrementalSort:
+		{
+			Path* subpath = ((IncrementalSortPath*)path)->spath.subpath;
+			double bytes = subpath->rows * (MAXALIGN(subpath->pathtarget->width) + MAXALIGN(SizeofHeapTupleHeader));
+			if (bytes > work_mem * 1024.0)
+				return "sort spill";
+			break;
+		}
+		case T_HashJoin:
+			if (((HashPath*)path)->num_batches > 1)
+				return "hash batching";
+			break;
+		case T_Agg:
+			if (IsA(path, AggPath) &&
+			    (((AggPath*)path)->aggstrategy == AGG_HASHED || ((AggPath*)path)->aggstrategy == AGG_MIXED))
+			{
+				double bytes = ((AggPath*)path)->numGroups * (MAXALIGN(path->pathtarget->width) + MAXALIGN(SizeofMinimalTupleHeader));
+				if (bytes > (double)get_hash_memory_limit())
+					return "hash aggregate spill";
+			}
+			break;
+		case T_Memoize:
+			return "memoize";
+		default:
+			break;
+	}
+	return NULL;
+}
+
+static bool
+collect_subplan_ids(Node* node, List** ids)
+{
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, RestrictInfo))
+		return collect_subplan_ids((Node*)((RestrictInfo*)node)->clause, ids);
+
+	if (IsA(node, SubPlan))
+		*ids = list_append_unique_int(*ids, ((SubPlan*)node)->plan_id);
+
+	return expression_tree_walker(node, collect_subplan_ids, ids);
+}
+
+// The subplans evaluated by the node's target list or quals.
+static List*
+referenced_subplans(Path* path)
+{
+	List* ids = NIL;
+	collect_subplan_ids((Node*)path->pathtarget->exprs, &ids);
+	if (path->param_info)
+		collect_subplan_ids((Node*)path->param_info->ppi_clauses, &ids);
+	if (path->parent && IS_SIMPLE_REL(path->parent))
+		collect_subplan_ids((Node*)path->parent->baserestrictinfo, &ids);
+
+	switch (path->pathtype)
+	{
+		case T_NestLoop:
+		case T_MergeJoin:
+		case T_HashJoin:
+			collect_subplan_ids((Node*)((JoinPath*)path)->joinrestrictinfo, &ids);
+			break;
+		case T_Agg:
+			if (IsA(path, AggPath))
+				collect_subplan_ids((Node*)((AggPath*)path)->qual, &ids);
+			break;
+		case T_Group:
+			collect_subplan_ids((Node*)((GroupPath*)path)->qual, &ids);
+			break;
+		default:
+			break;
+	}
+	return ids;
+}
+
+/*
+ * Mark the node and everything above it as nonlinear. A subplan root has no
+ * parent in its own tree, so it hands off to the nodes that evaluate it, or
+ * to the main root when nothing does (init plans are charged there).
+ */
+static void
+mark_nonlinear(List* nodes, CoefNode* cn)
+{
+	while (cn != NULL && !cn->propagated)
+	{
+		ListCell* lc;
+		bool referenced = false;
+
+		cn->propagated = true;
+		cn->linear = false;
+		if (cn->parent_id >= 0)
+		{
+			cn = list_nth(nodes, cn->parent_id);
+			continue;
+		}
+
+		if (cn->plan_id == 0)
+			break;
+
+		foreach(lc, nodes)
+		{
+			CoefNode* ref = (CoefNode*)lfirst(lc);
+			if (list_member_int(ref->subplan_ids, cn->plan_id))
+			{
+				referenced = true;
+				mark_nonlinear(nodes, ref);
+			}
+		}
+
+		cn = NULL;
+		if (!referenced)
+		{
+			foreach(lc, nodes)
+			{
+				CoefNode* top = (CoefNode*)lfirst(lc);
+				if (top->plan_id == 0 && top->parent_id < 0)
+				{
+					cn = top;
+					break;
+				}
+			}
+		}
+	}
+}
+
+static void
+coef_before(int node_id, int parent_id, int plan_id, PlannerInfo* root, Path* path, void* context)
+{
+	CoefContext* ctx = (CoefContext*)context;
+	if (ctx->evaluation == 0)
+	{
+		CoefNode* cn = palloc0(sizeof(CoefNode));
+		cn->node_id = node_id;
+		cn->parent_id = parent_id;
+		cn->plan_id = plan_id;
+		cn->node_type = hypocost_pathtype_name(path);
+		cn->relid = hypocost_path_relid(root, path);
+		cn->linear = true;
+		cn->subplan_ids = referenced_subplans(path);
+		ctx->nodes = lappend(ctx->nodes, cn);
+	}
+	else if (node_id >= list_length(ctx->nodes))
+	{
+		ereport(ERROR,
+				(errcode(ERRCODE_INTERNAL_ERROR),
+				 errmsg("plan shape changed between recosts")));
+	}
+	ctx->visited++;
+}
+
+static void
+coef_after(int node_id, PlannerInfo* root, Path* path, void* context)
+{
+	CoefContext* ctx = (CoefContext*)context;
+	CoefNode* cn = list_nth(ctx->nodes, node_id);
+	cn->totals[ctx->evaluation] = path->total_cost;
+	if (ctx->evaluation == 0)
+		cn->reason = nonlinear_reason(path);
+}
+
+Datum
+hypocost_coefficients(PG_FUNCTION_ARGS)
+{
+	static const char* param_names[NUM_COEFFICIENTS] = {
+		"seq_page_cost", "random_page_cost", "cpu_tuple_cost", "cpu_index_tuple_cost", "cpu_operator_cost"
+	};
+	double* params[NUM_COEFFICIENTS] = {
+		&hypocost_seq_page_cost, &hypocost_random_page_cost,
+		hypocost_cpu_tuple_cost >= 0 ? &hypocost_cpu_tuple_cost : &cpu_tuple_cost,
+		hypocost_cpu_index_tuple_cost >= 0 ? &hypocost_cpu_index_tuple_cost : &cpu_index_tuple_cost,
+		hypocost_cpu_operator_cost >= 0 ? &hypocost_cpu_operator_cost : &cpu_operator_cost
+	};
+	char* query_string = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	double base[NUM_COEFFICIENTS];
+	double steps[NUM_COEFFICIENTS];
+	Tuplestorestate *tupstore;
+	TupleDesc tupdesc;
+	Query* query;
+	struct HypocostCapture* cap;
+	CoefContext ctx = { .nodes = NIL, .evaluation = 0, .visited = 0 };
+	HypocostObserver observer = {
+		.before = coef_before,
+		.after = coef_after,
+		.context = &ctx
+	};
+	ListCell* lc;
+	int k;
+
+	tupstore = hypocost_init_srf(fcinfo, &tupdesc);
+	for (k = 0; k < NUM_COEFFICIENTS; k++)
+	{
+		base[k] = *params[k];
+		steps[k] = Max(base[k] * 0.5, 0.001);
+	}
+
+	query = hypocost_parse_query(query_string);
+	cap = hypocost_capture(query, query_string, CURSOR_OPT_PARALLEL_OK, NULL);
+	PG_TRY();
+	{
+		// Substitutions rewrite the tree on the first recost; settle the shape first.
+		if (hypocost_substitute)
+			hypocost_recost(cap, NULL);
+
+		hypocost_recost(cap, &observer);
+		for (k = 0; k < NUM_COEFFICIENTS; k++)
+		{
+			int i;
+			for (i = 1; i <= 2; i++)
+			{
+				CHECK_FOR_INTERRUPTS();
+				*params[k] = base[k] + i * steps[k];
+				ctx.evaluation = 1 + 2 * k + (i - 1);
+				ctx.visited = 0;
+				hypocost_recost(cap, &observer);
+				if (ctx.visited != list_length(ctx.nodes))
+					ereport(ERROR,
+							(errcode(ERRCODE_INTERNAL_ERROR),
+							 errmsg("plan shape changed between recosts")));
+			}
+			*params[k] = base[k];
+		}
+	}
+	PG_FINALLY();
+	{
+		for (k = 0; k < NUM_COEFFICIENTS; k++)
+			*params[k] = base[k];
+		hypocost_release();
+	}
+	PG_END_TRY();
+
+	// Finite differences: one step gives the slope, a second step checks it is constant.
+	foreach(lc, ctx.nodes)
+	{
+		CoefNode* cn = (CoefNode*)lfirst(lc);
+		cn->constant = cn->totals[0];
+		for (k = 0; k < NUM_COEFFICIENTS; k++)
+		{
+			double first = (cn->totals[1 + 2 * k] - cn->totals[0]) / steps[k];
+			double second = (cn->totals[2 + 2 * k] - cn->totals[1 + 2 * k]) / steps[k];
+			cn->coefs[k] = first;
+			cn->constant -= first * base[k];
+			if (fabs(first - second) > 1e-6 * Max(1.0, fabs(first)))
+			{
+				cn->linear = false;
+				if (cn->reason == NULL)
+					cn->reason = psprintf("not linear in %s", param_names[k]);
+			}
+		}
+
+		if (cn->reason != NULL)
+			cn->linear = false;
+	}
+
+	// A node is only linear if everything beneath it is, subplans included.
+	foreach(lc, ctx.nodes)
+	{
+		CoefNode* cn = (CoefNode*)lfirst(lc);
+		if (!cn->linear)
+			mark_nonlinear(ctx.nodes, cn);
+	}
+
+	foreach(lc, ctx.nodes)
+	{
+		CoefNode* cn = (CoefNode*)lfirst(lc);
+		Datum values[13];
+		bool nulls[13];
+		const char* relname = OidIsValid(cn->relid) ? get_rel_name(cn->relid) : NULL;
+
+		memset(nulls, 0, sizeof(nulls));
+		values[0] = Int32GetDatum(cn->node_id);
+		values[1] = Int32GetDatum(cn->parent_id);
+		nulls[1] = cn->parent_id < 0;
+		values[2] = Int32GetDatum(cn->plan_id);
+		values[3] = CStringGetTextDatum(cn->node_type);
+		if (relname)
+			values[4] = CStringGetTextDatum(relname);
+		else
+			nulls[4] = true;
+		values[5] = Float8GetDatum(cn->constant);
+		for (k = 0; k < NUM_COEFFICIENTS; k++)
+			values[6 + k] = Float8GetDatum(cn->coefs[k]);
+		values[11] = BoolGetDatum(cn->linear);
+		if (cn->reason)
+			values[12] = CStringGetTextDatum(cn->reason);
+		else
+			nulls[12] = true;
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+
+	return (Datum) 0;
+}
+
+
+typedef struct CandidatesContext
+{
+	Tuplestorestate* tupstore;
+	TupleDesc tupdesc;
+} CandidatesContext;
+
+static void
+candidates_record(int node_id, PlannerInfo* root, IndexPath* ipath, HypocostCandidate* cand, bool chosen, void* context)
+{
+	CandidatesContext* ctx = (CandidatesContext*)context;
+	Oid relid = hypocost_path_relid(root, (Path*)ipath);
+	Datum values[9];
+	bool nulls[9];
+
+	memset(nulls, 0, sizeof(nulls));
+	values[0] = Int32GetDatum(node_id);
+	if (OidIsValid(relid))
+		values[1] = CStringGetTextDatum(get_rel_name(relid));
+	else
+		nulls[1] = true;
+	values[2] = CStringGetTextDatum(hypocost_index_name(ipath->indexinfo->indexoid));
+	values[3] = CStringGetTextDatum(hypocost_index_name(cand->path.indexinfo->indexoid));
+	values[4] = CStringGetTextDatum(hypocost_plantype_name(cand->path.path.pathtype));
+	values[5] = Float8GetDatum(cand->path.path.startup_cost);
+	values[6] = Float8GetDatum(cand->path.path.total_cost);
+	values[7] = Float8GetDatum(cand->path.path.rows);
+	values[8] = BoolGetDatum(chosen);
+	tuplestore_putvalues(ctx->tupstore, ctx->tupdesc, values, nulls);
+}
+
+Datum
+hypocost_candidates(PG_FUNCTION_ARGS)
+{
+	char* query_string = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	CandidatesContext ctx;
+	HypocostObserver observer = {
+		.candidate = candidates_record,
+		.context = &ctx
+	};
+	Query* query;
+	struct HypocostCapture* cap;
+
+	ctx.tupstore = hypocost_init_srf(fcinfo, &ctx.tupdesc);
+	query = hypocost_parse_query(query_string);
+	cap = hypocost_capture(query, query_string, CURSOR_OPT_PARALLEL_OK, NULL);
+	PG_TRY();
+	{
+		hypocost_recost(cap, &observer);
+	}
+	PG_FINALLY();
+	{
+		hypocost_release();
+	}
+	PG_END_TRY();
+
+	return (Datum) 0;
+}
+
+
+/* A relation scan or join of a plan, keyed by the range table entries below it */
+typedef struct ShapeNode
+{
+	Bitmapset* relids;
+	bool join;
+	char* method;
+} ShapeNode;
+
+static Bitmapset* collect_shape(Plan* plan, List** nodes);
+
+static Bitmapset*
+collect_plans(List* plans, List** nodes)
+{
+	Bitmapset* relids = NULL;
+	ListCell* lc;
+
+	foreach(lc, plans)
+		relids = bms_join(relids, collect_shape((Plan*)lfirst(lc), nodes));
+	return relids;
+}
+
+static void
+append_bitmap_indexes(Plan* plan, StringInfo buf, bool* first)
+{
+	ListCell* lc;
+
+	if (plan == NULL)
+		return;
+
+	if (IsA(plan, BitmapIndexScan))
+	{
+		appendStringInfo(buf, *first ? " using %s" : ", %s", hypocost_index_name(((BitmapIndexScan*)plan)->indexid));
+		*first = false;
+	}
+	else if (IsA(plan, BitmapAnd))
+	{
+		foreach(lc, ((BitmapAnd*)plan)->bitmapplans)
+			append_bitmap_indexes((Plan*)lfirst(lc), buf, first);
+	}
+	else if (IsA(plan, BitmapOr))
+	{
+		foreach(lc, ((BitmapOr*)plan)->bitmapplans)
+			append_bitmap_indexes((Plan*)lfirst(lc), buf, first);
+	}
+}
+
+// Returns the range table entries scanned below plan.
+static Bitmapset*
+collect_shape(Plan* plan, List** nodes)
+{
+	Bitmapset* relids;
+	ShapeNode* sn;
+	StringInfoData method;
+	bool first = true;
+
+	if (plan == NULL)
+		return NULL;
+
+	relids = bms_join(collect_shape(outerPlan(plan), nodes), collect_shape(innerPlan(plan), nodes));
+	switch (nodeTag(plan))
+	{
+		case T_Append:
+			relids = bms_join(relids, collect_plans(((Append*)plan)->appendplans, nodes));
+			break;
+		case T_MergeAppend:
+			relids = bms_join(relids, collect_plans(((MergeAppend*)plan)->mergeplans, nodes));
+			break;
+		case T_SubqueryScan:
+			relids = bms_join(relids, collect_shape(((SubqueryScan*)plan)->subplan, nodes));
+			break;
+		case T_CustomScan:
+			relids = bms_join(relids, collect_plans(((CustomScan*)plan)->custom_plans, nodes));
+			break;
+		default:
+			break;
+	}
+
+	switch (nodeTag(plan))
+	{
+		case T_SeqScan:
+		case T_SampleScan:
+		case T_IndexScan:
+		case T_IndexOnlyScan:
+		case T_BitmapHeapScan:
+		case T_TidScan:
+		case T_TidRangeScan:
+		case T_ForeignScan:
+		{
+			Index scanrelid = ((Scan*)plan)->scanrelid;
+			// A foreign join has no relation of its own.
+			if (scanrelid == 0)
+				break;
+
+			initStringInfo(&method);
+			appendStringInfoString(&method, hypocost_plantype_name(nodeTag(plan)));
+			if (IsA(plan, IndexScan))
+				appendStringInfo(&method, " using %s", hypocost_index_name(((IndexScan*)plan)->indexid));
+			else if (IsA(plan, IndexOnlyScan))
+				appendStringInfo(&method, " using %s", hypocost_index_name(((IndexOnlyScan*)plan)->indexid));
+			else if (IsA(plan, BitmapHeapScan))
+				append_bitmap_indexes(outerPlan(plan), &method, &first);
+
+			relids = bms_add_member(relids, scanrelid);
+			sn = palloc0(sizeof(ShapeNode));
+			sn->relids = bms_make_singleton(scanrelid);
+			sn->method = method.data;
+			*nodes = lappend(*nodes, sn);
+			break;
+		}
+		case T_HashJoin:
+		case T_MergeJoin:
+		case T_NestLoop:
+			sn = palloc0(sizeof(ShapeNode));
+			sn->relids = bms_copy(relids);
+			sn->join = true;
+			sn->method = pstrdup(hypocost_plantype_name(nodeTag(plan)));
+			*nodes = lappend(*nodes, sn);
+			break;
+		default:
+			break;
+	}
+	return relids;
+}
+
+static List*
+plan_shape(PlannedStmt* stmt)
+{
+	List* nodes = NIL;
+
+	collect_shape(stmt->planTree, &nodes);
+	collect_plans(stmt->subplans, &nodes);
+	return nodes;
+}
+
+static ShapeNode*
+find_shape(List* nodes, ShapeNode* sn)
+{
+	ListCell* lc;
+
+	foreach(lc, nodes)
+	{
+		ShapeNode* other = (ShapeNode*)lfirst(lc);
+		if (other->join == sn->join && bms_equal(other->relids, sn->relids))
+			return other;
+	}
+	return NULL;
+}
+
+static char*
+shape_relations(PlannedStmt* stmt, Bitmapset* relids)
+{
+	StringInfoData buf;
+	int rti = -1;
+
+	initStringInfo(&buf);
+	while ((rti = bms_next_member(relids, rti)) >= 0)
+	{
+		RangeTblEntry* rte = rt_fetch(rti, stmt->rtable);
+		appendStringInfo(&buf, "%s%s", buf.len > 0 ? ", " : "", rte->eref->aliasname);
+	}
+	return buf.data;
+}
+
+static void
+put_regret(Tuplestorestate* tupstore, TupleDesc tupdesc, Cost preserved, Cost replanned,
+		   PlannedStmt* stmt, ShapeNode* sn, ShapeNode* preserved_sn, ShapeNode* replanned_sn)
+{
+	Datum values[7];
+	bool nulls[7];
+
+	memset(nulls, 0, sizeof(nulls));
+	values[0] = Float8GetDatum(preserved);
+	values[1] = Float8GetDatum(replanned);
+	values[2] = Float8GetDatum(preserved / replanned);
+	nulls[2] = replanned <= 0;
+	if (sn != NULL)
+	{
+		values[3] = CStringGetTextDatum(sn->join ? "join" : "scan");
+		values[4] = CStringGetTextDatum(shape_relations(stmt, sn->relids));
+	}
+	else
+	{
+		nulls[3] = true;
+		nulls[4] = true;
+	}
+	if (preserved_sn != NULL)
+		values[5] = CStringGetTextDatum(preserved_sn->method);
+	else
+		nulls[5] = true;
+	if (replanned_sn != NULL)
+		values[6] = CStringGetTextDatum(replanned_sn->method);
+	else
+		nulls[6] = true;
+	tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+}
+
+Datum
+hypocost_regret(PG_FUNCTION_ARGS)
+{
+	char* query_string = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	Tuplestorestate *tupstore;
+	TupleDesc tupdesc;
+	Query* query;
+	Query* unconstrained;
+	struct HypocostCapture* cap;
+	PlannedStmt* replanned;
+	List* preserved_shape;
+	List* replanned_shape;
+	Cost preserved_total = 0;
+	Cost replanned_total;
+	ListCell* lc;
+	bool differs = false;
+
+	// The replanning pass only sees the wired settings; anything else would compare two different models.
+	if (hypocost_whatif_active() || hypocost_rules_active() || hypocost_parallel_workers >= 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("hypocost_regret cannot compare plans under what-if overrides, index substitutions or hypocost.parallel_workers"),
+				 errhint("Call hypocost_whatif_reset() and hypocost_substitute_reset(), and reset hypocost.parallel_workers.")));
+
+	tupstore = hypocost_init_srf(fcinfo, &tupdesc);
+	query = hypocost_parse_query(query_string);
+	// Planning scribbles on the query, so the third pass needs its own copy.
+	unconstrained = copyObject(query);
+
+	cap = hypocost_capture(query, query_string, CURSOR_OPT_PARALLEL_OK, NULL);
+	PG_TRY();
+	{
+		hypocost_recost(cap, NULL);
+		preserved_total = cap->path->total_cost;
+	}
+	PG_FINALLY();
+	{
+		hypocost_release();
+	}
+	PG_END_TRY();
+
+	// After the release, so that no what-if statistics leak into the third pass.
+	replanned = hypocost_plan_unconstrained(unconstrained, query_string, CURSOR_OPT_PARALLEL_OK);
+	replanned_total = replanned->planTree->total_cost;
+
+	preserved_shape = plan_shape(cap->plan);
+	replanned_shape = plan_shape(replanned);
+	foreach(lc, preserved_shape)
+	{
+		ShapeNode* sn = (ShapeNode*)lfirst(lc);
+		ShapeNode* other = find_shape(replanned_shape, sn);
+		if (other == NULL || strcmp(sn->method, other->method) != 0)
+		{
+			put_regret(tupstore, tupdesc, preserved_total, replanned_total, cap->plan, sn, sn, other);
+			differs = true;
+		}
+	}
+	foreach(lc, replanned_shape)
+	{
+		ShapeNode* sn = (ShapeNode*)lfirst(lc);
+		if (find_shape(preserved_shape, sn) == NULL)
+		{
+			put_regret(tupstore, tupdesc, preserved_total, replanned_total, replanned, sn, NULL, sn);
+			differs = true;
+		}
+	}
+
+	// Same shape; still report the totals.
+	if (!differs)
+		put_regret(tupstore, tupdesc, preserved_total, replanned_total, NULL, NULL, NULL, NULL);
+	return (Datum) 0;
+}
+
+
+typedef struct MemoryReportContext
+{
+	Tuplestorestate* tupstore;
+	TupleDesc tupdesc;
+	List* parent_ids;
+	List* plan_ids;
+} MemoryReportContext;
+
+static double
+tuple_bytes(double tuples, int width)
+{
+	return tuples * (MAXALIGN(width) + MAXALIGN(SizeofHeapTupleHeader));
+}
+
+// Mirrors cost_tuplesort(): the number of initial runs written out, or 1 if the sort fits.
+static double
+sort_batches(double tuples, int width, double limit_tuples)
+{
+	double sort_mem_bytes = work_mem * 1024.0;
+	double input_bytes;
+	double output_bytes;
+
+	tuples = Max(tuples, 2.0);
+	input_bytes = tuple_bytes(tuples, width);
+	if (limit_tuples > 0 && limit_tuples < tuples)
+		output_bytes = tuple_bytes(limit_tuples, width);
+	else
+		output_bytes = input_bytes;
+
+	// A bounded heap sort never spills.
+	if (output_bytes <= sort_mem_bytes)
+		return 1;
+	return ceil(input_bytes / sort_mem_bytes);
+}
+
+// Mirrors cost_incremental_sort(): each group of presorted rows is sorted on its own.
+static double
+incremental_sort_batches(PlannerInfo* root, IncrementalSortPath* path)
+{
+	Path* subpath = path->spath.subpath;
+	double input_tuples = subpath->rows;
+	double input_groups;
+	List* presorted = NIL;
+	bool unknown_varno = false;
+	ListCell* lc;
+
+	foreach(lc, path->spath.path.pathkeys)
+	{
+		PathKey* key = (PathKey*)lfirst(lc);
+		EquivalenceMember* member = (EquivalenceMember*)linitial(key->pk_eclass->ec_members);
+		if (list_length(presorted) >= path->nPresortedCols)
+			break;
+
+		if (bms_is_member(0, pull_varnos(root, (Node*)member->em_expr)))
+		{
+			unknown_varno = true;
+			break;
+		}
+		presorted = lappend(presorted, member->em_expr);
+	}
+
+	if (unknown_varno)
+		input_groups = Min(DEFAULT_NUM_DISTINCT, input_tuples);
+	else
+		input_groups = estimate_num_groups(root, presorted, input_tuples, NULL, NULL);
+	return sort_batches(1.5 * input_tuples / Max(input_groups, 1.0), subpath->pathtarget->width, path->limit_tuples);
+}
+
+// The memory limit (in kB) and batches of a node that works in memory, or false for other nodes.
+static bool
+node_memory(PlannerInfo* root, Path* path, double* limit, double* batches)
+{
+	switch (path->pathtype)
+	{
+		case T_Sort:
+		{
+			SortPath* spath = (SortPath*)path;
+			*limit = work_mem;
+			*batches = sort_batches(spath->subpath->rows, spath->subpath->pathtarget->width, spath->limit_tuples);
+			return true;
+		}
+		case T_IncrementalSort:
+			*limit = work_mem;
+			*batches = incremental_sort_batches(root, (IncrementalSortPath*)path);
+			return true;
+		case T_HashJoin:
+			*limit = get_hash_memory_limit() / 1024.0;
+			*batches = ((HashPath*)path)->num_batches;
+			return true;
+		case T_Agg:
+		{
+			AggPath* apath = (AggPath*)path;
+			Size transition_space;
+			double entry_size;
+			Size mem_limit;
+			uint64 ngroups_limit;
+			int num_partitions;
+
+			if (!IsA(path, AggPath) || (apath->aggstrategy != AGG_HASHED && apath->aggstrategy != AGG_MIXED))
+				return false;
+
+			// Same arithmetic as cost_agg().
+			transition_space = apath->aggcosts_valid ? apath->aggcosts.transitionSpace : 0;
+			entry_size = hash_agg_entry_size(list_length(root->aggtransinfos), apath->subpath->pathtarget->width, transition_space);
+			hash_agg_set_limits(entry_size, apath->numGroups, 0, &mem_limit, &ngroups_limit, &num_partitions);
+			*limit = mem_limit / 1024.0;
+			*batches = Max(ceil(Max(apath->numGroups * entry_size / mem_limit, apath->numGroups / ngroups_limit)), 1.0);
+			return true;
+		}
+		default:
+			return false;
+	}
+}
+
+static void
+memory_before(int node_id, int parent_id, int plan_id, PlannerInfo* root, Path* path, void* context)
+{
+	MemoryReportContext* ctx = (MemoryReportContext*)context;
+	ctx->parent_ids = lappend_int(ctx->parent_ids, parent_id);
+	ctx->plan_ids = lappend_int(ctx->plan_ids, plan_id);
+}
+
+static void
+memory_after(int node_id, PlannerInfo* root, Path* path, void* context)
+{
+	MemoryReportContext* ctx = (MemoryReportContext*)context;
+	int parent_id = list_nth_int(ctx->parent_ids, node_id);
+	double limit;
+	double batches;
+	Datum values[7];
+	bool nulls[7];
+
+	// Called with the recost's settings still wired.
+	if (!node_memory(root, path, &limit, &batches))
+		return;
+
+	memset(nulls, 0, sizeof(nulls));
+	values[0] = Int32GetDatum(node_id);
+	values[1] = Int32GetDatum(parent_id);
+	nulls[1] = parent_id < 0;
+	values[2] = Int32GetDatum(list_nth_int(ctx->plan_ids, node_id));
+	values[3] = CStringGetTextDatum(hypocost_pathtype_name(path));
+	values[4] = Float8GetDatum(limit);
+	values[5] = BoolGetDatum(batches > 1);
+	values[6] = Float8GetDatum(batches);
+	tuplestore_putvalues(ctx->tupstore, ctx->tupdesc, values, nulls);
+}
+
+Datum
+hypocost_memory(PG_FUNCTION_ARGS)
+{
+	char* query_string = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	MemoryReportContext ctx = { .parent_ids = NIL, .plan_ids = NIL };
+	HypocostObserver observer = {
+		.before = memory_before,
+		.after = memory_after,
+		.context = &ctx
+	};
+	Query* query;
+	struct HypocostCapture* cap;
+
+	ctx.tupstore = hypocost_init_srf(fcinfo, &ctx.tupdesc);
+	query = hypocost_parse_query(query_string);
+	cap = hypocost_capture(query, query_string, CURSOR_OPT_PARALLEL_OK, NULL);
+	PG_TRY();
+	{
+		hypocost_recost(cap, &observer);
+	}
+	PG_FINALLY();
+	{
+		hypocost_release();
+	}
+	PG_END_TRY();
+
+	return (Datum) 0;
+}
+
+
+/* What cost_memoize_rescan() predicts for a Memoize node */
+typedef struct MemoizeEstimate
+{
+	double ndistinct;
+	double est_entries;
+	double hit_ratio;
+	double evict_ratio;
+	Cost rescan_startup;
+	Cost rescan_total;
+} MemoizeEstimate;
+
+// Mirrors cost_memoize_rescan(), which is static, under the settings currently in effect.
+static void
+estimate_memoize(PlannerInfo* root, MemoizePath* mpath, MemoizeEstimate* est)
+{
+	EstimationInfo estinfo;
+	double tuples = mpath->subpath->rows;
+	double calls = mpath->calls;
+	int width = mpath->subpath->pathtarget->width;
+	double hash_mem_bytes = get_hash_memory_limit();
+	double est_entry_bytes;
+	double est_cache_entries;
+
+	est_entry_bytes = tuple_bytes(tuples, width) + ExecEstimateCacheEntryOverheadBytes(tuples);
+	est_cache_entries = floor(hash_mem_bytes / est_entry_bytes);
+
+	// Without statistics, assume every lookup is for a distinct value.
+	est->ndistinct = estimate_num_groups(root, mpath->param_exprs, calls, NULL, &estinfo);
+	if ((estinfo.flags & SELFLAG_USED_DEFAULT) != 0)
+		est->ndistinct = calls;
+
+	est->est_entries = Min(Min(est->ndistinct, est_cache_entries), PG_UINT32_MAX);
+	est->evict_ratio = 1.0 - Min(est_cache_entries, est->ndistinct) / est->ndistinct;
+	est->hit_ratio = Max(((calls - est->ndistinct) / calls) *
+						 (est_cache_entries / Max(est->ndistinct, est_cache_entries)), 0.0);
+
+	est->rescan_total = mpath->subpath->total_cost * (1.0 - est->hit_ratio) + cpu_operator_cost;
+	est->rescan_total += cpu_tuple_cost * est->evict_ratio;
+	est->rescan_total += cpu_operator_cost / 10.0 * est->evict_ratio * tuples;
+	est->rescan_total += cpu_tuple_cost + cpu_operator_cost * tuples;
+	est->rescan_startup = mpath->subpath->startup_cost * (1.0 - est->hit_ratio) + cpu_tuple_cost;
+}
+
+static void
+memoize_after(int node_id, PlannerInfo* root, Path* path, void* context)
+{
+	MemoryReportContext* ctx = (MemoryReportContext*)context;
+	MemoizePath* mpath = (MemoizePath*)path;
+	int parent_id = list_nth_int(ctx->parent_ids, node_id);
+	MemoizeEstimate est;
+	Datum values[11];
+	bool nulls[11];
+
+	// Called with the recost's settings still wired.
+	if (!IsA(path, MemoizePath))
+		return;
+
+	estimate_memoize(root, mpath, &est);
+	memset(nulls, 0, sizeof(nulls));
+	values[0] = Int32GetDatum(node_id);
+	values[1] = Int32GetDatum(parent_id);
+	nulls[1] = parent_id < 0;
+	values[2] = Int32GetDatum(list_nth_int(ctx->plan_ids, node_id));
+	values[3] = Float8GetDatum(mpath->calls);
+	values[4] = Float8GetDatum(est.ndistinct);
+	values[5] = Float8GetDatum(est.est_entries);
+	values[6] = Float8GetDatum(get_hash_memory_limit() / 1024.0);
+	values[7] = Float8GetDatum(est.hit_ratio);
+	values[8] = Float8GetDatum(est.evict_ratio);
+	values[9] = Float8GetDatum(est.rescan_startup);
+	values[10] = Float8GetDatum(est.rescan_total);
+	tuplestore_putvalues(ctx->tupstore, ctx->tupdesc, values, nulls);
+}
+
+Datum
+hypocost_memoize(PG_FUNCTION_ARGS)
+{
+	char* query_string = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	MemoryReportContext ctx = { .parent_ids = NIL, .plan_ids = NIL };
+	HypocostObserver observer = {
+		.before = memory_before,
+		.after = memoize_after,
+		.context = &ctx
+	};
+	Query* query;
+	struct HypocostCapture* cap;
+
+	ctx.tupstore = hypocost_init_srf(fcinfo, &ctx.tupdesc);
+	query = hypocost_parse_query(query_string);
+	cap = hypocost_capture(query, query_string, CURSOR_OPT_PARALLEL_OK, NULL);
+	PG_TRY();
+	{
+		hypocost_recost(cap, &observer);
+	}
+	PG_FINALLY();
+	{
+		hypocost_release();
+	}
+	PG_END_TRY();
+
+	return (Datum) 0;
+}
@@ -1,11 +1,132 @@
 #include "postgres.h"
+#include "commands/createas.h"
+#include "executor/executor.h"
 #include "tcop/tcopprot.h"
+#include "utils/snapmgr.h"
 #include "hypocost.h"
 
 bool hypocost_in_explain_analyze = false;
+bool hypocost_in_explain = false;
 struct PartialExplainContext *es_ctx = NULL;
 
 
+// Break down where the planning time of a recosted statement went.
+static void
+explain_hypocost_summary(ExplainState *es)
+{
+	HypocostCounters* c = &hypocost_counters;
+	int tag;
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		appendStringInfoString(es->str, "Hypocost:\n");
+		es->indent++;
+	}
+	else
+		ExplainOpenGroup("Hypocost", "Hypocost", true, es);
+
+	ExplainPropertyFloat("First Pass Time", "ms", c->first_pass_time, 3, es);
+	ExplainPropertyFloat("Second Pass Time", "ms", c->second_pass_time, 3, es);
+	ExplainPropertyFloat("Recost Time", "ms", c->recost_time, 3, es);
+	ExplainPropertyInteger("Substitution Lookups", NULL, c->match_lookups, es);
+	ExplainPropertyInteger("Relation Rebuilds", NULL, c->fake_opt_builds, es);
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+	{
+		appendStringInfoSpaces(es->str, es->indent * 2);
+		appendStringInfoString(es->str, "Recosted Nodes:\n");
+		es->indent++;
+	}
+	else
+		ExplainOpenGroup("Recosted Nodes", "Recosted Nodes", true, es);
+
+	for (tag = 0; tag <= T_Limit; tag++)
+	{
+		if (c->nodes_recosted[tag] > 0)
+			ExplainPropertyInteger(hypocost_plantype_name((NodeTag)tag), NULL, c->nodes_recosted[tag], es);
+	}
+
+	if (es->format == EXPLAIN_FORMAT_TEXT)
+		es->indent -= 2;
+	else
+	{
+		ExplainCloseGroup("Recosted Nodes", "Recosted Nodes", true, es);
+		ExplainCloseGroup("Hypocost", "Hypocost", true, es);
+	}
+}
+
+
+// The non-text half of explain.c's show_buffer_usage() for planning buffers.
+static void
+explain_planning_buffers(ExplainState *es, const BufferUsage *usage)
+{
+	ExplainOpenGroup("Planning", "Planning", true, es);
+	ExplainPropertyInteger("Shared Hit Blocks", NULL, usage->shared_blks_hit, es);
+	ExplainPropertyInteger("Shared Read Blocks", NULL, usage->shared_blks_read, es);
+	ExplainPropertyInteger("Shared Dirtied Blocks", NULL, usage->shared_blks_dirtied, es);
+	ExplainPropertyInteger("Shared Written Blocks", NULL, usage->shared_blks_written, es);
+	ExplainPropertyInteger("Local Hit Blocks", NULL, usage->local_blks_hit, es);
+	ExplainPropertyInteger("Local Read Blocks", NULL, usage->local_blks_read, es);
+	ExplainPropertyInteger("Local Dirtied Blocks", NULL, usage->local_blks_dirtied, es);
+	ExplainPropertyInteger("Local Written Blocks", NULL, usage->local_blks_written, es);
+	ExplainPropertyInteger("Temp Read Blocks", NULL, usage->temp_blks_read, es);
+	ExplainPropertyInteger("Temp Written Blocks", NULL, usage->temp_blks_written, es);
+	if (track_io_timing)
+	{
+		ExplainPropertyFloat("I/O Read Time", "ms", INSTR_TIME_GET_MILLISEC(usage->blk_read_time), 3, es);
+		ExplainPropertyFloat("I/O Write Time", "ms", INSTR_TIME_GET_MILLISEC(usage->blk_write_time), 3, es);
+		ExplainPropertyFloat("Temp I/O Read Time", "ms", INSTR_TIME_GET_MILLISEC(usage->temp_blk_read_time), 3, es);
+		ExplainPropertyFloat("Temp I/O Write Time", "ms", INSTR_TIME_GET_MILLISEC(usage->temp_blk_write_time), 3, es);
+	}
+	ExplainCloseGroup("Planning", "Planning", true, es);
+}
+
+/*
+ * ExplainOnePlan() for a recosted plan in a structured format, minus
+ * ANALYZE, which never reaches here. It puts the Hypocost section inside
+ * the plan's object, next to "Planning Time".
+ */
+static void
+explain_recosted_plan(PlannedStmt *plan, IntoClause *into, ExplainState *es,
+					  const char *queryString, ParamListInfo params,
+					  QueryEnvironment *queryEnv, const instr_time *planduration,
+					  const BufferUsage *bufusage)
+{
+	QueryDesc  *queryDesc;
+	int			eflags = EXEC_FLAG_EXPLAIN_ONLY;
+
+	if (into)
+		eflags |= GetIntoRelEFlags(into);
+
+	PushCopiedSnapshot(GetActiveSnapshot());
+	UpdateActiveSnapshotCommandId();
+	queryDesc = CreateQueryDesc(plan, queryString, GetActiveSnapshot(), InvalidSnapshot,
+								None_Receiver, params, queryEnv, 0);
+	ExecutorStart(queryDesc, eflags);
+
+	ExplainOpenGroup("Query", NULL, true, es);
+	ExplainPrintPlan(es, queryDesc);
+
+	if (bufusage)
+		explain_planning_buffers(es, bufusage);
+
+	if (es->summary && planduration)
+		ExplainPropertyFloat("Planning Time", "ms", 1000.0 * INSTR_TIME_GET_DOUBLE(*planduration), 3, es);
+
+	if (es->summary)
+		explain_hypocost_summary(es);
+
+	if (es->costs)
+		ExplainPrintJITSummary(es, queryDesc);
+
+	ExecutorEnd(queryDesc);
+	FreeQueryDesc(queryDesc);
+	PopActiveSnapshot();
+
+	ExplainCloseGroup("Query", NULL, true, es);
+}
+
+
 void
 hypocost_explain(Query *query, int cursorOptions,
 				 IntoClause *into, ExplainState *es,
@@ -34,10 +155,12 @@ hypocost_explain(Query *query, int cursorOptions,
 		if (es->buffers)
 			bufusage_start = pgBufferUsage;
 		INSTR_TIME_SET_CURRENT(planstart);
+		hypocost_in_explain = true;
 
 		// Do this when only EXPLAIN (and no ANALYZE).
 		if (hypocost_enable &&
 		    hypocost_alter_explain &&
+		    hypocost_activated(queryString) &&
 		    !hypocost_in_explain_analyze &&
 		    (es->format == EXPLAIN_FORMAT_TEXT || es->format == EXPLAIN_FORMAT_JSON))
 		{
@@ -56,6 +179,7 @@ hypocost_explain(Query *query, int cursorOptions,
 
 		/* plan the query */
 		plan = pg_plan_query(query, queryString, cursorOptions, params);
+		hypocost_in_explain = false;
 
 		INSTR_TIME_SET_CURRENT(planduration);
 		INSTR_TIME_SUBTRACT(planduration, planstart);
@@ -84,20 +208,28 @@ hypocost_explain(Query *query, int cursorOptions,
 		}
 
 		/* run it (if needed) and produce output */
-		ExplainOnePlan(plan, into, es, queryString, params, queryEnv, &planduration, (es->buffers ? &bufusage : NULL));
-
-		if (es_ctx != NULL)
+		if (es_ctx != NULL && es->format == EXPLAIN_FORMAT_JSON)
 		{
-			if (es->format == EXPLAIN_FORMAT_JSON)
+			explain_recosted_plan(plan, into, es, queryString, params, queryEnv, &planduration, (es->buffers ? &bufusage : NULL));
+			ExplainCloseGroup("Plans", NULL, false, es);
+			es_ctx = NULL;
+		}
+		else
+		{
+			ExplainOnePlan(plan, into, es, queryString, params, queryEnv, &planduration, (es->buffers ? &bufusage : NULL));
+
+			if (es_ctx != NULL)
 			{
-				ExplainCloseGroup("Plans", NULL, false, es);
+				if (es->summary)
+					explain_hypocost_summary(es);
+				es_ctx = NULL;
 			}
-			es_ctx = NULL;
 		}
 	}
         PG_FINALLY();
         {
 		es_ctx = NULL;
+		hypocost_in_explain = false;
         }
         PG_END_TRY();
 }
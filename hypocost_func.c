@@ -1,10 +1,14 @@
 #include "postgres.h"
 #include "fmgr.h"
 #include "catalog/namespace.h"
+#include "common/hashfn.h"
 #include "utils/rel.h"
 #include "utils/builtins.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/palloc.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
 #include "optimizer/clauses.h"
 #include "optimizer/plancat.h"
 #include "optimizer/paths.h"
@@ -22,11 +26,117 @@ typedef struct SubEntry
 {
     char *search;
     Oid index_oid;
+    int seq;
 } SubEntry;
 
 /* Global list to store entries */
 static List *sublist = NIL;
 
+/* Bumped whenever sublist changes so cached matches can be dropped */
+static uint64 sublist_generation = 0;
+
+/*
+ * Rules compiled by pattern when they are registered. An index name is
+ * matched by probing its substrings of each registered pattern length, so
+ * the cost depends on the name, not on the number of rules.
+ */
+typedef struct PatternEntry
+{
+    char search[NAMEDATALEN];
+    List *rules;
+} PatternEntry;
+
+static MemoryContext rules_cxt = NULL;
+static HTAB *pattern_index = NULL;
+static bool pattern_lengths[NAMEDATALEN];
+
+/* Rules matching an index, cached per index OID across planning cycles */
+typedef struct MatchEntry
+{
+    Oid index_oid;
+    List *matches;
+} MatchEntry;
+
+static MemoryContext match_cxt = NULL;
+static HTAB *match_cache = NULL;
+static uint64 match_generation = 0;
+static bool match_cache_valid = false;
+static bool callback_registered = false;
+
+/* Relations rebuilt by hypocost_fake_opt(), keyed by how they were built */
+typedef struct FakeOptKey
+{
+    PlannerInfo *root;
+    Index relid;
+    Oid filter_oid;
+    bool build_indexes;
+    bool allowbitmap;
+} FakeOptKey;
+
+typedef struct FakeOptVariant
+{
+    List *filter_oids;
+    RelOptInfo *rel;
+} FakeOptVariant;
+
+typedef struct FakeOptEntry
+{
+    FakeOptKey key;
+    List *variants;
+} FakeOptEntry;
+
+/* Memory that lives for one planning cycle; reset by hypocost_end_cycle() */
+static MemoryContext cycle_cxt = NULL;
+static HTAB *fake_opt_cache = NULL;
+
+/*
+ * Renaming an index changes which rules match it. A caller may be walking a
+ * cached list, so a full reset waits for the next lookup.
+ */
+static void
+match_relcache_callback(Datum arg, Oid relid)
+{
+    if (match_cache == NULL || !match_cache_valid)
+        return;
+
+    if (!OidIsValid(relid))
+        match_cache_valid = false;
+    else
+        hash_search(match_cache, &relid, HASH_REMOVE, NULL);
+}
+
+static void
+compile_rule(SubEntry *entry)
+{
+    PatternEntry *pattern;
+    bool found;
+    MemoryContext oldcontext;
+
+    // No index name is long enough to contain it.
+    if (strlen(entry->search) >= NAMEDATALEN)
+        return;
+
+    if (pattern_index == NULL)
+    {
+        HASHCTL ctl;
+        if (rules_cxt == NULL)
+            rules_cxt = AllocSetContextCreate(TopMemoryContext, "hypocost substitution rules", ALLOCSET_DEFAULT_SIZES);
+        ctl.keysize = NAMEDATALEN;
+        ctl.entrysize = sizeof(PatternEntry);
+        ctl.hcxt = rules_cxt;
+        pattern_index = hash_create("hypocost substitution patterns", 64, &ctl, HASH_ELEM | HASH_STRINGS | HASH_CONTEXT);
+        memset(pattern_lengths, 0, sizeof(pattern_lengths));
+    }
+
+    pattern = (PatternEntry *) hash_search(pattern_index, entry->search, HASH_ENTER, &found);
+    if (!found)
+        pattern->rules = NIL;
+    oldcontext = MemoryContextSwitchTo(rules_cxt);
+    pattern->rules = lappend(pattern->rules, entry);
+    MemoryContextSwitchTo(oldcontext);
+    pattern_lengths[strlen(entry->search)] = true;
+}
+
 PG_FUNCTION_INFO_V1(hypocost_substitute_index);
 PG_FUNCTION_INFO_V1(hypocost_substitute_reset);
 
@@ -49,10 +159,13 @@ Datum hypocost_substitute_index(PG_FUNCTION_ARGS)
     new_entry = (SubEntry *) palloc(sizeof(SubEntry));
     new_entry->search = search;
     new_entry->index_oid = index_oid;
+    new_entry->seq = list_length(sublist);
 
     /* Add the new entry to the global list */
     sublist = lappend(sublist, new_entry);
+    sublist_generation++;
     MemoryContextSwitchTo(oldcontext);
+    compile_rule(new_entry);
     PG_RETURN_BOOL(true);
 }
 
@@ -68,13 +181,221 @@ Datum hypocost_substitute_reset(PG_FUNCTION_ARGS)
     }
     list_free(sublist);
     sublist = NIL;
+    sublist_generation++;
+    if (rules_cxt != NULL)
+        MemoryContextReset(rules_cxt);
+    pattern_index = NULL;
     MemoryContextSwitchTo(oldcontext);
     PG_RETURN_BOOL(true);
 }
 
 
+uint64
+hypocost_rules_hash(void)
+{
+	ListCell *cell;
+	uint64 hash = 0;
+
+	// Rules only matter when they are applied.
+	if (!hypocost_substitute)
+		return 0;
+
+	foreach(cell, sublist)
+	{
+		SubEntry *entry = (SubEntry *) lfirst(cell);
+		hash = hash_combine64(hash, hash_bytes_extended((const unsigned char*)entry->search, strlen(entry->search) + 1, 0));
+		hash = hash_combine64(hash, hash_bytes_uint32_extended(entry->index_oid, 0));
+	}
+	return hash;
+}
+
+bool
+hypocost_rules_active(void)
+{
+	return hypocost_substitute && sublist != NIL;
+}
+
+/*
+ * Whether planning in this backend may see hypothetical indexes. They are
+ * local to the backend and their OIDs collide between backends. An index
+ * adviser adds them to relations while planning, so once one is hooked in
+ * any relation may have some.
+ */
+bool
+hypocost_hypothetical_indexes(void)
+{
+	ListCell *cell;
+
+	if (get_relation_info_hook != NULL)
+		return true;
+	if (explain_get_index_name_hook == NULL || !hypocost_rules_active())
+		return false;
+
+	foreach(cell, sublist)
+	{
+		if (explain_get_index_name_hook(((SubEntry *) lfirst(cell))->index_oid) != NULL)
+			return true;
+	}
+	return false;
+}
+
+
+const char*
+hypocost_index_name(Oid indexoid)
+{
+	// Hypothetical indexes are only known to the EXPLAIN hook.
+	const char *indexname = NULL;
+	if (explain_get_index_name_hook)
+		indexname = explain_get_index_name_hook(indexoid);
+
+	if (indexname == NULL)
+		return get_rel_name(indexoid);
+	return pstrdup(indexname);
+}
+
+
+static void
+ensure_cycle_cxt(void)
+{
+	if (cycle_cxt == NULL)
+		cycle_cxt = AllocSetContextCreate(TopMemoryContext, "hypocost cycle", ALLOCSET_DEFAULT_SIZES);
+}
+
+void
+hypocost_end_cycle(void)
+{
+	if (cycle_cxt != NULL)
+	{
+		hypocost_counters.mem_allocated += MemoryContextMemAllocated(cycle_cxt, true);
+		MemoryContextReset(cycle_cxt);
+	}
+	fake_opt_cache = NULL;
+}
+
+static int
+rule_seq_cmp(const ListCell *a, const ListCell *b)
+{
+	return ((SubEntry *) lfirst(a))->seq - ((SubEntry *) lfirst(b))->seq;
+}
+
+// The rules whose pattern occurs in name, in registration order.
+static List*
+match_patterns(const char* name)
+{
+	List* patterns = NIL;
+	List* matches = NIL;
+	ListCell* cell;
+	int namelen = strlen(name);
+	int len;
+	int start;
+	char probe[NAMEDATALEN];
+
+	for (len = 0; len < NAMEDATALEN && len <= namelen; len++)
+	{
+		if (!pattern_lengths[len])
+			continue;
+		for (start = 0; start + len <= namelen; start++)
+		{
+			PatternEntry* pattern;
+			memcpy(probe, name + start, len);
+			probe[len] = '\0';
+			pattern = (PatternEntry*)hash_search(pattern_index, probe, HASH_FIND, NULL);
+			if (pattern != NULL)
+				patterns = list_append_unique_ptr(patterns, pattern);
+			// The empty pattern is found at the first position.
+			if (len == 0)
+				break;
+		}
+	}
+
+	foreach(cell, patterns)
+		matches = list_concat(matches, ((PatternEntry*)lfirst(cell))->rules);
+	if (list_length(patterns) > 1)
+		list_sort(matches, rule_seq_cmp);
+	list_free(patterns);
+	return matches;
+}
+
+/*
+ * Returns the substitution rules whose pattern matches the index name, in
+ * registration order. Names are resolved and matched once per index until
+ * the rules change or the index is invalidated.
+ */
+static List*
+matching_entries(Oid indexoid)
+{
+	MatchEntry* entry;
+	const char* indexname;
+	List* matches = NIL;
+	MemoryContext oldcontext;
+
+	if (sublist == NIL)
+		return NIL;
+
+	hypocost_counters.match_lookups++;
+	if (!callback_registered)
+	{
+		CacheRegisterRelcacheCallback(match_relcache_callback, (Datum) 0);
+		callback_registered = true;
+	}
+	// Resolving the name below may process invalidations, so settle the cache first.
+	indexname = NULL;
+	if (match_cache != NULL && match_cache_valid && match_generation == sublist_generation)
+	{
+		entry = (MatchEntry*)hash_search(match_cache, &indexoid, HASH_FIND, NULL);
+		if (entry != NULL)
+			return entry->matches;
+		indexname = hypocost_index_name(indexoid);
+	}
+	if (match_cache == NULL || !match_cache_valid || match_generation != sublist_generation)
+	{
+		HASHCTL ctl;
+		if (match_cxt == NULL)
+			match_cxt = AllocSetContextCreate(TopMemoryContext, "hypocost substitution matches", ALLOCSET_DEFAULT_SIZES);
+		else
+			MemoryContextReset(match_cxt);
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(MatchEntry);
+		ctl.hcxt = match_cxt;
+		match_cache = hash_create("hypocost substitution matches", 64, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+		match_generation = sublist_generation;
+		match_cache_valid = true;
+		indexname = hypocost_index_name(indexoid);
+	}
+
+	oldcontext = MemoryContextSwitchTo(match_cxt);
+	if (indexname != NULL && pattern_index != NULL)
+		matches = match_patterns(indexname);
+	MemoryContextSwitchTo(oldcontext);
+
+	entry = (MatchEntry*)hash_search(match_cache, &indexoid, HASH_ENTER, NULL);
+	entry->matches = matches;
+	return matches;
+}
+
+
+// Fingerprint of the rules that a scan on this index would be substituted with.
+uint32
+hypocost_match_signature(Oid indexoid)
+{
+	ListCell *cell;
+	uint32 hash = 0;
+
+	if (!(hypocost_in_explain_analyze || hypocost_substitute))
+		return 0;
+
+	foreach(cell, matching_entries(indexoid))
+	{
+		SubEntry *entry = (SubEntry *) lfirst(cell);
+		hash = hash_combine(hash, string_hash(entry->search, strlen(entry->search) + 1));
+		hash = hash_combine(hash, hash_bytes_uint32(entry->index_oid));
+	}
+	return hash;
+}
+
+
 static RelOptInfo*
-hypocost_fake_opt(PlannerInfo* root, Path *path, Oid filter_oid, List* filter_oids, bool build_indexes, bool allowbitmap)
+build_fake_opt(PlannerInfo* root, Path *path, Oid filter_oid, List* filter_oids, bool build_indexes, bool allowbitmap)
 {
 	RelOptInfo* rel = NULL;
 	bool old_enable_bitmapscan = enable_bitmapscan;
@@ -118,6 +439,7 @@ hypocost_fake_opt(PlannerInfo* root, Path *path, Oid filter_oid, List* filter_oi
 		rel->pages = roi->pages;
 		rel->tuples = roi->tuples;
 		set_baserel_size_estimates(root, rel);
+		hypocost_whatif_apply_rebuilt(root, rel);
 
 		{
 			ListCell* l;
@@ -175,6 +497,67 @@ hypocost_fake_opt(PlannerInfo* root, Path *path, Oid filter_oid, List* filter_oi
 	return rel;
 }
 
+/*
+ * Memoized build_fake_opt(). The same relation is often rebuilt for several
+ * parameterizations or subplans within one planning cycle; the rebuilt
+ * relation and its index paths only depend on the arguments below.
+ */
+static RelOptInfo*
+hypocost_fake_opt(PlannerInfo* root, Path *path, Oid filter_oid, List* filter_oids, bool build_indexes, bool allowbitmap)
+{
+	FakeOptKey key;
+	FakeOptEntry* entry;
+	FakeOptVariant* variant;
+	ListCell* lc;
+	bool found;
+	MemoryContext oldcontext;
+	RelOptInfo* rel;
+
+	if (fake_opt_cache == NULL)
+	{
+		HASHCTL ctl;
+		ensure_cycle_cxt();
+		ctl.keysize = sizeof(FakeOptKey);
+		ctl.entrysize = sizeof(FakeOptEntry);
+		ctl.hcxt = cycle_cxt;
+		fake_opt_cache = hash_create("hypocost rebuilt relations", 64, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	// Zero the padding since the key is hashed as a blob.
+	memset(&key, 0x00, sizeof(FakeOptKey));
+	key.root = root;
+	key.relid = path->parent->relid;
+	key.filter_oid = filter_oid;
+	key.build_indexes = build_indexes;
+	key.allowbitmap = allowbitmap;
+
+	entry = (FakeOptEntry*)hash_search(fake_opt_cache, &key, HASH_FIND, NULL);
+	if (entry != NULL)
+	{
+		foreach(lc, entry->variants)
+		{
+			variant = (FakeOptVariant*)lfirst(lc);
+			if (equal(variant->filter_oids, filter_oids))
+				return variant->rel;
+		}
+	}
+
+	rel = build_fake_opt(root, path, filter_oid, filter_oids, build_indexes, allowbitmap);
+	hypocost_counters.fake_opt_builds++;
+
+	entry = (FakeOptEntry*)hash_search(fake_opt_cache, &key, HASH_ENTER, &found);
+	if (!found)
+		entry->variants = NIL;
+
+	oldcontext = MemoryContextSwitchTo(cycle_cxt);
+	variant = (FakeOptVariant*)palloc(sizeof(FakeOptVariant));
+	variant->filter_oids = list_copy(filter_oids);
+	variant->rel = rel;
+	entry->variants = lappend(entry->variants, variant);
+	MemoryContextSwitchTo(oldcontext);
+	return rel;
+}
+
 List*
 hypocost_check_replace(PlannerInfo* root, Path* path, bool inc_pk)
 {
@@ -214,23 +597,14 @@ hypocost_check_replace(PlannerInfo* root, Path* path, bool inc_pk)
 	{
 		ListCell *cell;
 		IndexPath* ipath = (IndexPath*)path;
-		const char *indexname = explain_get_index_name_hook(ipath->indexinfo->indexoid);
-		if (indexname == NULL) {
-			indexname = get_rel_name(ipath->indexinfo->indexoid);
-		} else {
-			indexname = pstrdup(indexname);
-		}
-
-		foreach(cell, sublist)
+		// Already in registration order; rules that match nothing cost nothing.
+		foreach(cell, matching_entries(ipath->indexinfo->indexoid))
 		{
 			SubEntry *entry = (SubEntry *) lfirst(cell);
-			if (strstr(indexname, entry->search) != NULL)
+			RelOptInfo* rel = hypocost_fake_opt(root, path, entry->index_oid, NIL, false, true);
+			if (rel && list_length(rel->indexlist) > 0)
 			{
-				RelOptInfo* rel = hypocost_fake_opt(root, path, entry->index_oid, NIL, false, true);
-				if (rel && list_length(rel->indexlist) > 0)
-				{
-					return list_make1_oid(entry->index_oid);
-				}
+				return list_make1_oid(entry->index_oid);
 			}
 		}
 
@@ -243,6 +617,41 @@ hypocost_check_replace(PlannerInfo* root, Path* path, bool inc_pk)
 	return NIL;
 }
 
+/*
+ * Copies the nodes of a bitmap qual tree. The rebuilt relation is cached and
+ * shared by every scan of it, and recosting writes costs into these nodes.
+ */
+static Path*
+copy_bitmapqual(Path* path)
+{
+	ListCell* lc;
+	if (IsA(path, BitmapAndPath))
+	{
+		BitmapAndPath* apath = palloc(sizeof(BitmapAndPath));
+		memcpy(apath, path, sizeof(BitmapAndPath));
+		apath->bitmapquals = NIL;
+		foreach(lc, ((BitmapAndPath*)path)->bitmapquals)
+			apath->bitmapquals = lappend(apath->bitmapquals, copy_bitmapqual(lfirst(lc)));
+		return (Path*)apath;
+	}
+	else if (IsA(path, BitmapOrPath))
+	{
+		BitmapOrPath* opath = palloc(sizeof(BitmapOrPath));
+		memcpy(opath, path, sizeof(BitmapOrPath));
+		opath->bitmapquals = NIL;
+		foreach(lc, ((BitmapOrPath*)path)->bitmapquals)
+			opath->bitmapquals = lappend(opath->bitmapquals, copy_bitmapqual(lfirst(lc)));
+		return (Path*)opath;
+	}
+	else if (IsA(path, IndexPath))
+	{
+		IndexPath* ipath = palloc(sizeof(IndexPath));
+		memcpy(ipath, path, sizeof(IndexPath));
+		return (Path*)ipath;
+	}
+	return path;
+}
+
 void hypocost_substitute_bpath(PlannerInfo* root, Path* path, List* oids)
 {
 	BitmapHeapPath* bpath;
@@ -254,6 +663,7 @@ void hypocost_substitute_bpath(PlannerInfo* root, Path* path, List* oids)
 	{
 		ListCell* l;
 		RelOptInfo* rel = hypocost_fake_opt(root, (Path*)bpath, 0, oids, true, true);
+		hypocost_counters.subst_attempted++;
 		foreach(l, rel->pathlist)
 		{
 			struct Path* nipath = lfirst(l);
@@ -263,7 +673,8 @@ void hypocost_substitute_bpath(PlannerInfo* root, Path* path, List* oids)
 			{
 				// First, prioritize compare equal.
 				BitmapHeapPath* bnipath = (BitmapHeapPath*)nipath;
-				bpath->bitmapqual = bnipath->bitmapqual;
+				bpath->bitmapqual = copy_bitmapqual(bnipath->bitmapqual);
+				hypocost_counters.subst_succeeded++;
 				return;
 			}
 		}
@@ -276,7 +687,8 @@ void hypocost_substitute_bpath(PlannerInfo* root, Path* path, List* oids)
 			{
 				// Then, prioritize subset.
 				BitmapHeapPath* bnipath = (BitmapHeapPath*)nipath;
-				bpath->bitmapqual = bnipath->bitmapqual;
+				bpath->bitmapqual = copy_bitmapqual(bnipath->bitmapqual);
+				hypocost_counters.subst_succeeded++;
 				return;
 			}
 		}
@@ -288,169 +700,173 @@ void hypocost_substitute_bpath(PlannerInfo* root, Path* path, List* oids)
 			if (nipath != NULL && IsA(nipath, BitmapHeapPath) && (nppath == NULL))
 			{
 				BitmapHeapPath* bnipath = (BitmapHeapPath*)nipath;
-				bpath->bitmapqual = bnipath->bitmapqual;
+				bpath->bitmapqual = copy_bitmapqual(bnipath->bitmapqual);
+				hypocost_counters.subst_succeeded++;
 				return;
 			}
 		}
 	}
 }
 
-void hypocost_check_substitute(PlannerInfo* root, IndexPath* ipath, Path* outer)
+// The rebuilt relation's entry for the index; the rebuild may keep other indexes too.
+static IndexOptInfo*
+find_index_info(RelOptInfo* rel, Oid index_oid)
 {
-	if (list_length(sublist) == 0)
-		return;
-
-	if (outer != NULL)
+	ListCell* l;
+	foreach(l, rel->indexlist)
 	{
-		if (IsA(outer, BitmapOrPath) || IsA(outer, BitmapAndPath) || IsA(outer, BitmapHeapPath))
-		{
-			return;
-		}
+		IndexOptInfo* iinfo = (IndexOptInfo*)lfirst(l);
+		if (iinfo->indexoid == index_oid)
+			return iinfo;
 	}
+	return NULL;
+}
 
-	if (ipath->path.parent)
-	{
-		ListCell *cell;
-		bool overwritten = false;
-		RelOptInfo* ipparent = ipath->path.parent;
-		ParamPathInfo* pinfo = ipath->path.param_info;
-		const char *indexname = explain_get_index_name_hook(ipath->indexinfo->indexoid);
-		if (indexname == NULL) {
-			indexname = get_rel_name(ipath->indexinfo->indexoid);
-		} else {
-			indexname = pstrdup(indexname);
-		}
+// Picks the rebuilt index path that best matches the parameterization and ordering of the scan.
+static IndexPath*
+find_candidate_path(IndexPath* ipath, RelOptInfo* rel, Oid index_oid)
+{
+	ListCell* l;
+	IndexPath* tpath = NULL;
+	ParamPathInfo* pinfo = ipath->path.param_info;
 
-		foreach(cell, sublist)
+	foreach(l, rel->pathlist)
+	{
+		struct Path* nipath = lfirst(l);
+		if (nipath != NULL && IsA(nipath, IndexPath))
 		{
-			SubEntry *entry = (SubEntry *) lfirst(cell);
-			if (strstr(indexname, entry->search) != NULL)
+			IndexPath* inipath = (IndexPath*)nipath;
+			ParamPathInfo* nppath = inipath->path.param_info;
+			IndexOptInfo* iinfo = inipath->indexinfo;
+			// Preserve the parameterization if possible...
+			if (iinfo->indexoid == index_oid && ((bool)pinfo) == ((bool)nppath))
 			{
-				RelOptInfo* rel = hypocost_fake_opt(root, (Path*)ipath, entry->index_oid, NIL, true, false);
-				if (rel)
+				if ((pinfo == NULL && nppath == NULL) ||
+				    (pinfo && nppath && bms_compare(pinfo->ppi_req_outer, nppath->ppi_req_outer) == 0))
 				{
-					ListCell* l;
-					IndexPath* tpath = NULL;
-					foreach(l, rel->pathlist)
+					if (tpath == NULL)
 					{
-						struct Path* nipath = lfirst(l);
-						if (nipath != NULL && IsA(nipath, IndexPath))
-						{
-							IndexPath* inipath = (IndexPath*)nipath;
-							ParamPathInfo* nppath = inipath->path.param_info;
-							IndexOptInfo* iinfo = inipath->indexinfo;
-							// Preserve the parameterization if possible...
-							if (iinfo->indexoid == entry->index_oid && ((bool)pinfo) == ((bool)nppath))
-							{
-								if ((pinfo == NULL && nppath == NULL) ||
-								    (pinfo && nppath && bms_compare(pinfo->ppi_req_outer, nppath->ppi_req_outer) == 0))
-								{
-									if (tpath == NULL)
-									{
-										// Find an exact param match first.
-										tpath = inipath;
-									}
-									else if (((bool)ipath->path.pathkeys) == ((bool)inipath->path.pathkeys))
-									{
-										// Override if the sort pathkeys matters...
-										tpath = inipath;
-									}
-								}
-							}
-						}
+						// Find an exact param match first.
+						tpath = inipath;
 					}
-
-					if (!tpath)
+					else if (((bool)ipath->path.pathkeys) == ((bool)inipath->path.pathkeys))
 					{
-						foreach(l, rel->pathlist)
-						{
-							struct Path* nipath = lfirst(l);
-							if (nipath != NULL && IsA(nipath, IndexPath))
-							{
-								IndexPath* inipath = (IndexPath*)nipath;
-								ParamPathInfo* nppath = inipath->path.param_info;
-								IndexOptInfo* iinfo = inipath->indexinfo;
-								// Preserve the parameterization if possible...
-								if (iinfo->indexoid == entry->index_oid && ((bool)pinfo) == ((bool)nppath))
-								{
-									// Allow for new path to be param-subset of the old one (i.e., relaxation).
-									if (pinfo && nppath && bms_is_subset(nppath->ppi_req_outer, pinfo->ppi_req_outer))
-									{
-										tpath = inipath;
-										break;
-									}
-								}
-							}
-						}
+						// Override if the sort pathkeys matters...
+						tpath = inipath;
 					}
+				}
+			}
+		}
+	}
 
-					if (tpath != NULL)
+	if (!tpath)
+	{
+		foreach(l, rel->pathlist)
+		{
+			struct Path* nipath = lfirst(l);
+			if (nipath != NULL && IsA(nipath, IndexPath))
+			{
+				IndexPath* inipath = (IndexPath*)nipath;
+				ParamPathInfo* nppath = inipath->path.param_info;
+				IndexOptInfo* iinfo = inipath->indexinfo;
+				// Preserve the parameterization if possible...
+				if (iinfo->indexoid == index_oid && ((bool)pinfo) == ((bool)nppath))
+				{
+					// Allow for new path to be param-subset of the old one (i.e., relaxation).
+					if (pinfo && nppath && bms_is_subset(nppath->ppi_req_outer, pinfo->ppi_req_outer))
 					{
-						// Hackery to preserve parallel + costs
-						tpath->path.parallel_aware = ipath->path.parallel_aware;
-						tpath->path.parallel_safe = ipath->path.parallel_safe;
-						tpath->path.parallel_workers = ipath->path.parallel_workers;
-						tpath->loop_count = ipath->loop_count;
-						tpath->partial_path = ipath->partial_path;
-						tpath->indexselectivity = ipath->indexselectivity;
-						tpath->indextotalcost = ipath->indextotalcost;
-						tpath->path.rows = ipath->path.rows;
-						tpath->path.startup_cost = ipath->path.startup_cost;
-						tpath->path.total_cost = ipath->path.total_cost;
-						tpath->path.param_info = ipath->path.param_info;
-						// This seems even darker....
-						tpath->path.pathkeys = ipath->path.pathkeys;
-						tpath->path.pathtarget = ipath->path.pathtarget;
-						// Attempt an override.. Just do a memcpy()  and try to fix up the RelOptInfo...
-						memcpy(ipath, tpath, sizeof(IndexPath));
-						ipath->path.parent = ipparent;
-						overwritten = true;
+						tpath = inipath;
 						break;
 					}
+				}
+			}
+		}
+	}
+	return tpath;
+}
 
-					if (overwritten)
-					{
-						break;
-					}
+/*
+ * Returns the index paths that could replace the scan, one per matching rule
+ * that yields one, in registration order. Unless all is set, stops at the
+ * first. Applying a candidate is a memcpy() over the scan.
+ */
+List*
+hypocost_substitute_candidates(PlannerInfo* root, IndexPath* ipath, Path* outer, bool all)
+{
+	ListCell *cell;
+	List* matches;
+	List* candidates = NIL;
 
-                                       if (!overwritten && ipath->path.pathtype == T_IndexOnlyScan && list_length(rel->indexlist) > 0)
-                                       {
-                                               // Case where we would no longer generate an IndexOnlyScan.....
-                                               // Just try to degrade it to an IndexScan...
-                                               ipath->indexinfo = (IndexOptInfo*)list_nth(rel->indexlist, 0);
-                                               ipath->path.pathtype = T_IndexScan;
-                                               break;
-                                       }
-
-				       // if (!overwritten && ipath->path.pathtype == T_IndexOnlyScan && list_length(rel->indexlist) > 0)
-				       // {
-				       //         bool has_subplan = false;
-				       //         ListCell* clause;
-				       //         if (ipparent->joininfo)
-				       //         {
-				       //  	       foreach(clause, ipparent->joininfo)
-				       //  	       {
-				       //  		       RestrictInfo* r = lfirst(clause);
-				       //  		       if (contain_subplans((Node*)r->clause))
-				       //  		       {
-				       //  			       has_subplan = true;
-				       //  			       break;
-				       //  		       }
-				       //  	       }
-				       //         }
-
-				       //         if (has_subplan)
-				       //         {
-				       //  	       // Case where we would no longer generate an IndexOnlyScan.....
-				       //  	       // Just try to degrade it to an IndexScan...
-				       //  	       ipath->indexinfo = (IndexOptInfo*)list_nth(rel->indexlist, 0);
-				       //  	       ipath->path.pathtype = T_IndexScan;
-				       //  	       break;
-				       //         }
-				       // }
+	if (list_length(sublist) == 0)
+		return NIL;
 
-				}
-			}
+	if (outer != NULL)
+	{
+		if (IsA(outer, BitmapOrPath) || IsA(outer, BitmapAndPath) || IsA(outer, BitmapHeapPath))
+		{
+			return NIL;
 		}
 	}
+
+	if (ipath->path.parent == NULL)
+		return NIL;
+
+	matches = matching_entries(ipath->indexinfo->indexoid);
+	if (matches != NIL)
+		hypocost_counters.subst_attempted++;
+
+	foreach(cell, matches)
+	{
+		SubEntry *entry = (SubEntry *) lfirst(cell);
+		RelOptInfo* rel = hypocost_fake_opt(root, (Path*)ipath, entry->index_oid, NIL, true, false);
+		IndexPath* tpath;
+		IndexOptInfo* iinfo;
+		HypocostCandidate* cand;
+		if (rel == NULL)
+			continue;
+
+		tpath = find_candidate_path(ipath, rel, entry->index_oid);
+		if (tpath != NULL)
+		{
+			// Work on a copy; the rebuilt relation is cached and reused for other scans.
+			cand = palloc0(sizeof(HypocostCandidate));
+			cand->path = *tpath;
+
+			// Hackery to preserve parallel + costs
+			cand->path.path.parallel_aware = ipath->path.parallel_aware;
+			cand->path.path.parallel_safe = ipath->path.parallel_safe;
+			cand->path.path.parallel_workers = ipath->path.parallel_workers;
+			cand->path.loop_count = ipath->loop_count;
+			cand->path.partial_path = ipath->partial_path;
+			cand->path.indexselectivity = ipath->indexselectivity;
+			cand->path.indextotalcost = ipath->indextotalcost;
+			cand->path.path.rows = ipath->path.rows;
+			cand->path.path.startup_cost = ipath->path.startup_cost;
+			cand->path.path.total_cost = ipath->path.total_cost;
+			cand->path.path.param_info = ipath->path.param_info;
+			// This seems even darker....
+			cand->path.path.pathkeys = ipath->path.pathkeys;
+			cand->path.path.pathtarget = ipath->path.pathtarget;
+			// Fix up the RelOptInfo...
+			cand->path.path.parent = ipath->path.parent;
+		}
+		else if (ipath->path.pathtype == T_IndexOnlyScan &&
+				 (iinfo = find_index_info(rel, entry->index_oid)) != NULL)
+		{
+			// Case where we would no longer generate an IndexOnlyScan.....
+			// Just try to degrade it to an IndexScan...
+			cand = palloc0(sizeof(HypocostCandidate));
+			cand->path = *ipath;
+			cand->path.indexinfo = iinfo;
+			cand->path.path.pathtype = T_IndexScan;
+			cand->degraded = true;
+		}
+		else
+			continue;
+
+		candidates = lappend(candidates, cand);
+		if (!all)
+			break;
+	}
+	return candidates;
 }
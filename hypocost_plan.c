@@ -1,8 +1,10 @@
 #include "hypocost.h"
+#include "executor/executor.h"
 #include "optimizer/optimizer.h"
 #include "jit/jit.h"
 #include "miscadmin.h"
 #include "utils/guc.h"
+#include "utils/guc_tables.h"
 #include "optimizer/cost.h"
 #include "optimizer/planmain.h"
 #include "access/parallel.h"
@@ -12,8 +14,13 @@
 #include "optimizer/subselect.h"
 #include "optimizer/paths.h"
 #include "partitioning/partdesc.h"
+#include "portability/instr_time.h"
 #include "nodes/nodeFuncs.h"
 #include "utils/lsyscache.h"
+#include "utils/selfuncs.h"
+#include "utils/memutils.h"
+#include "storage/lmgr.h"
+#include "common/hashfn.h"
 
 
 bool hypocost_do_scribble = false;
@@ -22,10 +29,57 @@ int* valid_subplan_ids = NULL;
 
 struct GUCState original_guc;
 
+// State of the first planner pass that single-pass recosting reuses.
+static struct HypocostCapture* capture = NULL;
+
+// Whether subplans get turned back into Plans after recosting.
+static bool recost_build_plans = true;
+static HypocostObserver* recost_observer = NULL;
+
+// Preorder numbering of the nodes visited by a recost.
+static int recost_next_id = 0;
+static int recost_parent_id = -1;
+static int recost_plan_id = 0;
+
+// Prepared statement being recosted; incremental recosts skip clean subtrees.
+static HypocostPrepared* recost_prepared = NULL;
+static bool recost_incremental = false;
+
+// Once a lower bound on the root's total cost passes the budget, the recost gives up.
+static double recost_budget = -1;
+static Cost recost_bound = 0;
+static int recost_unbounded = 0;
+static bool recost_pruned = false;
+
+// Worker count the enclosing Gather was given, for the partial paths below it; -1 keeps theirs.
+static int recost_parallel_workers = -1;
+
+// Text of the statement being recosted, which node-id overrides are keyed on.
+static const char* recost_query_string = NULL;
+
+// A scan rewritten by a substitution, with what it was before.
+typedef struct SubstitutionUndo
+{
+		IndexPath* ipath;
+		IndexPath orig_index;
+		Path** bitmapqual;
+		Path* orig_bitmapqual;
+} SubstitutionUndo;
+
+static List* substitutions = NIL;
+
 
 struct GUCState {
 		double seq_page_cost;
 		double random_page_cost;
+		int work_mem;
+		double hash_mem_multiplier;
+		double cpu_tuple_cost;
+		double cpu_index_tuple_cost;
+		double cpu_operator_cost;
+		double parallel_setup_cost;
+		double parallel_tuple_cost;
+		int effective_cache_size;
 		bool enable_hashjoin;
 		bool enable_mergejoin;
 		bool enable_nestloop;
@@ -52,6 +106,14 @@ save_state(void)
 		struct GUCState save = {
 				.seq_page_cost = seq_page_cost,
 				.random_page_cost = random_page_cost,
+				.work_mem = work_mem,
+				.hash_mem_multiplier = hash_mem_multiplier,
+				.cpu_tuple_cost = cpu_tuple_cost,
+				.cpu_index_tuple_cost = cpu_index_tuple_cost,
+				.cpu_operator_cost = cpu_operator_cost,
+				.parallel_setup_cost = parallel_setup_cost,
+				.parallel_tuple_cost = parallel_tuple_cost,
+				.effective_cache_size = effective_cache_size,
 				.enable_hashjoin = enable_hashjoin,
 				.enable_mergejoin = enable_mergejoin,
 				.enable_nestloop = enable_nestloop,
@@ -91,8 +153,25 @@ wire_state(void)
 		enable_indexonlyscan = true;
 		enable_bitmapscan = true;
 
-		// Don't tamper with this as it would alter query plans..
-		// hash_mem_multiplier =
+		// Only the recost sees these, so the spills they predict never change the shape.
+		if (hypocost_work_mem >= 0)
+				work_mem = hypocost_work_mem;
+		if (hypocost_hash_mem_multiplier >= 0)
+				hash_mem_multiplier = hypocost_hash_mem_multiplier;
+
+		// The rest of the target machine's cost profile; -1 keeps the live value.
+		if (hypocost_cpu_tuple_cost >= 0)
+				cpu_tuple_cost = hypocost_cpu_tuple_cost;
+		if (hypocost_cpu_index_tuple_cost >= 0)
+				cpu_index_tuple_cost = hypocost_cpu_index_tuple_cost;
+		if (hypocost_cpu_operator_cost >= 0)
+				cpu_operator_cost = hypocost_cpu_operator_cost;
+		if (hypocost_parallel_setup_cost >= 0)
+				parallel_setup_cost = hypocost_parallel_setup_cost;
+		if (hypocost_parallel_tuple_cost >= 0)
+				parallel_tuple_cost = hypocost_parallel_tuple_cost;
+		if (hypocost_effective_cache_size >= 0)
+				effective_cache_size = hypocost_effective_cache_size;
 }
 
 static void
@@ -100,6 +179,14 @@ restore_state(struct GUCState s)
 {
 		seq_page_cost = s.seq_page_cost;
 		random_page_cost = s.random_page_cost;
+		work_mem = s.work_mem;
+		hash_mem_multiplier = s.hash_mem_multiplier;
+		cpu_tuple_cost = s.cpu_tuple_cost;
+		cpu_index_tuple_cost = s.cpu_index_tuple_cost;
+		cpu_operator_cost = s.cpu_operator_cost;
+		parallel_setup_cost = s.parallel_setup_cost;
+		parallel_tuple_cost = s.parallel_tuple_cost;
+		effective_cache_size = s.effective_cache_size;
 		enable_hashjoin = s.enable_hashjoin;
 		enable_mergejoin = s.enable_mergejoin;
 		enable_nestloop = s.enable_nestloop;
@@ -116,6 +203,84 @@ restore_state(struct GUCState s)
 }
 
 
+/*
+ * Digest of every planner setting EXPLAIN (SETTINGS) would report, i.e. every
+ * GUC_EXPLAIN setting away from its built-in default. These decide both the
+ * captured shape and the live side of the recost.
+ */
+static uint64
+planner_settings_hash(void)
+{
+		int num;
+		int i;
+		struct config_generic** gucs = get_explain_guc_options(&num);
+		uint64 hash = 0;
+
+		for (i = 0; i < num; i++)
+		{
+				const char* value = GetConfigOptionByName(gucs[i]->name, NULL, true);
+				hash = hash_combine64(hash, hash_bytes_extended((const unsigned char*)gucs[i]->name, strlen(gucs[i]->name), 0));
+				if (value != NULL)
+						hash = hash_combine64(hash, hash_bytes_extended((const unsigned char*)value, strlen(value), 0));
+		}
+		pfree(gucs);
+		return hash;
+}
+
+// Hypothetical settings a recost result depends on, on top of the planner's own.
+struct CostSettings {
+		double hypocost_seq_page_cost;
+		double hypocost_random_page_cost;
+		double hypocost_hash_mem_multiplier;
+		double hypocost_cpu_tuple_cost;
+		double hypocost_cpu_index_tuple_cost;
+		double hypocost_cpu_operator_cost;
+		double hypocost_parallel_setup_cost;
+		double hypocost_parallel_tuple_cost;
+		int hypocost_effective_cache_size;
+		int hypocost_parallel_workers;
+		int hypocost_work_mem;
+		bool hypocost_substitute;
+		int hypocost_substitute_mode;
+		uint64 whatif_hash;
+		uint64 planner_hash;
+};
+
+static uint64
+settings_hash(bool hypothetical)
+{
+		struct CostSettings s;
+
+		// Zero the padding since the struct is hashed as a blob.
+		memset(&s, 0x00, sizeof(struct CostSettings));
+		s.planner_hash = planner_settings_hash();
+		if (hypothetical)
+		{
+				s.hypocost_seq_page_cost = hypocost_seq_page_cost;
+				s.hypocost_random_page_cost = hypocost_random_page_cost;
+				s.hypocost_work_mem = hypocost_work_mem;
+				s.hypocost_hash_mem_multiplier = hypocost_hash_mem_multiplier;
+				s.hypocost_cpu_tuple_cost = hypocost_cpu_tuple_cost;
+				s.hypocost_cpu_index_tuple_cost = hypocost_cpu_index_tuple_cost;
+				s.hypocost_cpu_operator_cost = hypocost_cpu_operator_cost;
+				s.hypocost_parallel_setup_cost = hypocost_parallel_setup_cost;
+				s.hypocost_parallel_tuple_cost = hypocost_parallel_tuple_cost;
+				s.hypocost_effective_cache_size = hypocost_effective_cache_size;
+				s.hypocost_parallel_workers = hypocost_parallel_workers;
+				s.hypocost_substitute = hypocost_substitute;
+				s.hypocost_substitute_mode = hypocost_substitute_mode;
+				s.whatif_hash = hypocost_whatif_hash();
+		}
+		return hash_bytes_extended((const unsigned char*)&s, sizeof(struct CostSettings), 0);
+}
+
+uint64
+hypocost_settings_hash(void)
+{
+		return settings_hash(true);
+}
+
+
 static bool
 erase_restrictinfo_cost(Node *node, void* ctx)
 {
@@ -138,13 +303,200 @@ erase_restrictinfo_cost(Node *node, void* ctx)
 }
 
 
+/*
+ * What a prepared statement remembers about one path node. Costs themselves
+ * stay in the path, which is recosted in place.
+ */
+typedef struct PreparedNode
+{
+		Path* path;
+		PlannerInfo* root;
+		struct PreparedNode* parent;
+		int node_id;
+		int parent_id;
+		int plan_id;
+		bool under_bitmap;
+
+		// The node as the first pass left it, so a substitution can be undone.
+		NodeTag orig_pathtype;
+		Cost orig_startup;
+		Cost orig_total;
+		double orig_rows;
+		IndexPath orig_index;
+		Path* orig_bitmapqual;
+
+		// Substitution rules the last recost applied to the scan.
+		uint32 signature;
+		bool dirty;
+} PreparedNode;
+
+
+static bool recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer);
+
+// Scaled relations change the join sizes; re-derive them from the inputs unless rows were injected.
+// Join clauses cache their evaluation cost too, so clear it before the join is costed again.
 static void
-recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
+reestimate_join(PlannerInfo* root, JoinPath* jpath, JoinPathExtraData* extra)
+{
+		RelOptInfo* joinrel = jpath->path.parent;
+		ListCell* l;
+		foreach(l, jpath->joinrestrictinfo)
+		{
+				erase_restrictinfo_cost(lfirst(l), NULL);
+		}
+		foreach(l, extra->restrictlist)
+		{
+				erase_restrictinfo_cost(lfirst(l), NULL);
+		}
+
+		if (hypocost_whatif_rows_changed() && extra->sjinfo != NULL)
+		{
+				hypocost_whatif_reset_selectivity(jpath->joinrestrictinfo);
+				hypocost_whatif_reset_selectivity(extra->restrictlist);
+				hypocost_whatif_save(&joinrel->rows);
+				set_joinrel_size_estimates(root, joinrel, jpath->outerjoinpath->parent, jpath->innerjoinpath->parent,
+										   extra->sjinfo, extra->restrictlist);
+		}
+		hypocost_whatif_inject_rows(root, joinrel);
+}
+
+// Scaled relations and distinct counts change the number of groups; re-derive it from the input.
+static void
+reestimate_groups(PlannerInfo* root, List* groupClause, Path* subpath, double* numGroups)
+{
+		PathTarget* target = subpath->pathtarget;
+		List* exprs = NIL;
+		ListCell* lc;
+
+		if (!hypocost_whatif_rows_changed() || groupClause == NIL || target->sortgrouprefs == NULL)
+				return;
+
+		foreach(lc, groupClause)
+		{
+				SortGroupClause* sgc = (SortGroupClause*)lfirst(lc);
+				ListCell* le;
+				Expr* expr = NULL;
+				foreach(le, target->exprs)
+				{
+						if (get_pathtarget_sortgroupref(target, foreach_current_index(le)) == sgc->tleSortGroupRef)
+						{
+								expr = (Expr*)lfirst(le);
+								break;
+						}
+				}
+
+				// Keep the planner's estimate for anything the input doesn't carry.
+				if (expr == NULL)
+				{
+						list_free(exprs);
+						return;
+				}
+				exprs = lappend(exprs, expr);
+		}
+
+		hypocost_whatif_save(numGroups);
+		*numGroups = estimate_num_groups(root, exprs, subpath->rows, NULL, NULL);
+		list_free(exprs);
+}
+
+static void
+cost_candidate(PlannerInfo* root, IndexPath* ipath)
+{
+		ListCell* l;
+		foreach(l, ipath->indexinfo->indrestrictinfo)
+		{
+				erase_restrictinfo_cost(lfirst(l), NULL);
+		}
+		cost_index(ipath, root, ipath->loop_count, ipath->partial_path);
+}
+
+static void
+remember_substitution(SubstitutionUndo* undo)
+{
+		MemoryContext old = MemoryContextSwitchTo(TopMemoryContext);
+		substitutions = lappend(substitutions, undo);
+		MemoryContextSwitchTo(old);
+}
+
+// Substitute the scan with the first candidate, or the cheapest under hypocost.substitute_mode = cheapest.
+static void
+apply_candidate(PlannerInfo* root, IndexPath* ipath, List* candidates)
+{
+		HypocostCandidate* best = linitial(candidates);
+		SubstitutionUndo* undo;
+		ListCell* lc;
+
+		if (list_length(candidates) > 1 || (recost_observer && recost_observer->candidate))
+		{
+				foreach(lc, candidates)
+				{
+						HypocostCandidate* cand = (HypocostCandidate*)lfirst(lc);
+						cost_candidate(root, &cand->path);
+						if (hypocost_substitute_mode == HYPOCOST_SUBSTITUTE_CHEAPEST &&
+						    cand->path.path.total_cost < best->path.path.total_cost)
+								best = cand;
+				}
+		}
+
+		if (recost_observer && recost_observer->candidate)
+		{
+				foreach(lc, candidates)
+				{
+						HypocostCandidate* cand = (HypocostCandidate*)lfirst(lc);
+						recost_observer->candidate(recost_parent_id, root, ipath, cand, cand == best, recost_observer->context);
+				}
+		}
+
+		undo = MemoryContextAllocZero(TopMemoryContext, sizeof(SubstitutionUndo));
+		undo->ipath = ipath;
+		memcpy(&undo->orig_index, ipath, sizeof(IndexPath));
+		remember_substitution(undo);
+
+		memcpy(ipath, &best->path, sizeof(IndexPath));
+		if (best->degraded)
+				hypocost_counters.subst_degraded++;
+		else
+				hypocost_counters.subst_succeeded++;
+}
+
+// Whether the node reads pages of its relation, so that per-relation page costs apply.
+static bool
+reads_pages(Path* path)
+{
+		switch (path->pathtype)
+		{
+				case T_SeqScan:
+				case T_SampleScan:
+				case T_IndexScan:
+				case T_IndexOnlyScan:
+				case T_BitmapHeapScan:
+						return true;
+				default:
+						return false;
+		}
+}
+
+static void
+recompute_node(PlannerInfo* root, Path* path, Path* outer)
 {
 		const char* plantype = NULL;
+		double saved_seq_page_cost = seq_page_cost;
+		double saved_random_page_cost = random_page_cost;
+		bool page_costs;
 		/* Guard against stack overflow due to overly complex plans */
 		check_stack_depth();
 
+		// Relations on other storage; an error leaves these to the restore of the wired state.
+		page_costs = reads_pages(path) &&
+				hypocost_whatif_page_costs(root, path->parent, &seq_page_cost, &random_page_cost);
+
+		// Partial paths take their parallel divisor from here.
+		if (recost_parallel_workers >= 0 && path->parallel_workers > 0)
+		{
+				hypocost_whatif_save_workers(&path->parallel_workers);
+				path->parallel_workers = recost_parallel_workers;
+		}
+
 		switch (path->pathtype)
 		{
 				case T_SeqScan:
@@ -158,6 +510,7 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 							}
 						}
 						set_baserel_size_estimates(root, path->parent);
+						hypocost_whatif_inject_rows(root, path->parent);
 						cost_seqscan(path, root, path->parent, path->param_info);
 						break;
 				}
@@ -170,9 +523,14 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 						if (hypocost_in_explain_analyze || hypocost_substitute)
 						{
 							struct GUCState ts = save_state();
+							bool all = hypocost_substitute_mode == HYPOCOST_SUBSTITUTE_CHEAPEST ||
+									(recost_observer && recost_observer->candidate);
+							List* candidates;
 							restore_state(original_guc);
-							hypocost_check_substitute(root, ipath, outer);
+							candidates = hypocost_substitute_candidates(root, ipath, outer, all);
 							restore_state(ts);
+							if (candidates != NIL)
+								apply_candidate(root, ipath, candidates);
 						}
 
 						if (ipath->indexinfo)
@@ -225,7 +583,11 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 							if (oids != NIL)
 							{
 								struct GUCState ts = save_state();
+								SubstitutionUndo* undo = MemoryContextAllocZero(TopMemoryContext, sizeof(SubstitutionUndo));
 
+								undo->bitmapqual = &((BitmapHeapPath*)path)->bitmapqual;
+								undo->orig_bitmapqual = *undo->bitmapqual;
+								remember_substitution(undo);
 								list_free(oids);
 								// Now get all OIDs under.
 								oids = hypocost_check_replace(root, path, true);
@@ -262,6 +624,7 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 						JoinCostWorkspace workspace;
 						recompute_pathcosts(root, ((HashPath*)path)->jpath.outerjoinpath, NULL);
 						recompute_pathcosts(root, ((HashPath*)path)->jpath.innerjoinpath, NULL);
+						reestimate_join(root, &((HashPath*)path)->jpath, &((HashPath*)path)->extra);
 						initial_cost_hashjoin(
 								root,
 								&workspace,
@@ -286,6 +649,7 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 						bool materialize_inner = ((MergePath*)path)->materialize_inner;
 						recompute_pathcosts(root, ((MergePath*)path)->jpath.outerjoinpath, NULL);
 						recompute_pathcosts(root, ((MergePath*)path)->jpath.innerjoinpath, NULL);
+						reestimate_join(root, &((MergePath*)path)->jpath, &((MergePath*)path)->extra);
 						initial_cost_mergejoin(
 								root,
 								&workspace,
@@ -310,8 +674,18 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 				}
 				case T_NestLoop: {
 						JoinCostWorkspace workspace;
-						recompute_pathcosts(root, ((NestPath*)path)->jpath.outerjoinpath, NULL);
-						recompute_pathcosts(root, ((NestPath*)path)->jpath.innerjoinpath, NULL);
+						Path* outerpath = ((NestPath*)path)->jpath.outerjoinpath;
+						Path* innerpath = ((NestPath*)path)->jpath.innerjoinpath;
+						recompute_pathcosts(root, outerpath, NULL);
+
+						// Memoize is looked up once per outer row, and cost_rescan() derives its hit ratio from that.
+						if (IsA(innerpath, MemoizePath) && ((MemoizePath*)innerpath)->calls != clamp_row_est(outerpath->rows))
+						{
+								hypocost_whatif_save(&((MemoizePath*)innerpath)->calls);
+								((MemoizePath*)innerpath)->calls = clamp_row_est(outerpath->rows);
+						}
+						recompute_pathcosts(root, innerpath, NULL);
+						reestimate_join(root, &((NestPath*)path)->jpath, &((NestPath*)path)->extra);
 						initial_cost_nestloop(
 								root,
 								&workspace, 
@@ -424,7 +798,14 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 						double *rows = NULL;
 						Cost		input_startup_cost = 0;
 						Cost		input_total_cost = 0;
+						int outer_workers = recost_parallel_workers;
+						if (hypocost_whatif_gather_workers(recost_parent_id, &recost_parallel_workers))
+						{
+								hypocost_whatif_save_workers(&((GatherMergePath*)path)->num_workers);
+								((GatherMergePath*)path)->num_workers = recost_parallel_workers;
+						}
 						recompute_pathcosts(root, ((GatherMergePath*)path)->subpath, NULL);
+						recost_parallel_workers = outer_workers;
 						if (pathkeys_contained_in(((GatherMergePath*)path)->path.pathkeys, ((GatherMergePath*)path)->subpath->pathkeys))
 						{
 								/* Subpath is adequately ordered, we won't need to sort it */
@@ -468,7 +849,14 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 				}
 				case T_Gather: {
 						double *rows = NULL;
+						int outer_workers = recost_parallel_workers;
+						if (hypocost_whatif_gather_workers(recost_parent_id, &recost_parallel_workers))
+						{
+								hypocost_whatif_save_workers(&((GatherPath*)path)->num_workers);
+								((GatherPath*)path)->num_workers = recost_parallel_workers;
+						}
 						recompute_pathcosts(root, ((GatherPath*)path)->subpath, NULL);
+						recost_parallel_workers = outer_workers;
 						if (((GatherPath*)path)->override_rows_valid)
 						{
 								rows = &((GatherPath*)path)->override_rows;
@@ -486,6 +874,7 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 				case T_Memoize:
 						MemoizePath* mpath = (MemoizePath*)path;
 						recompute_pathcosts(root, ((MemoizePath*)path)->subpath, NULL);
+						// The first scan, as create_memoize_path() costs it; the Nested Loop above charges the rescans.
 						mpath->path.startup_cost = mpath->subpath->startup_cost + cpu_tuple_cost;
 						mpath->path.total_cost = mpath->subpath->total_cost + cpu_tuple_cost;
 						mpath->path.rows = mpath->subpath->rows;
@@ -533,6 +922,7 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 				case T_Group:
 						Assert(IsA(path, GroupPath));
 						recompute_pathcosts(root, ((GroupPath*)path)->subpath, NULL);
+						reestimate_groups(root, ((GroupPath*)path)->groupClause, ((GroupPath*)path)->subpath, &((GroupPath*)path)->num_groups);
 						cost_group(
 								path,
 								root,
@@ -574,6 +964,7 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 								AggClauseCosts *costs = NULL;
 								Assert(IsA(path, AggPath));
 								recompute_pathcosts(root, ((AggPath*)path)->subpath, NULL);
+								reestimate_groups(root, ((AggPath*)path)->groupClause, ((AggPath*)path)->subpath, &((AggPath*)path)->numGroups);
 								if (((AggPath*)path)->aggcosts_valid)
 										costs = &((AggPath*)path)->aggcosts;
 
@@ -698,6 +1089,23 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 						path->total_cost += path->pathtarget->cost.startup + path->pathtarget->cost.per_tuple * path->rows;
 						break;
 				}
+				case T_ModifyTable: {
+						// As create_modifytable_path() costs it: the table modification itself is free.
+						ModifyTablePath* mtpath = (ModifyTablePath*)path;
+						recompute_pathcosts(root, mtpath->subpath, NULL);
+						path->startup_cost = mtpath->subpath->startup_cost;
+						path->total_cost = mtpath->subpath->total_cost;
+						path->rows = mtpath->returningLists != NIL ? mtpath->subpath->rows : 0;
+						break;
+				}
+				case T_LockRows: {
+						LockRowsPath* lrpath = (LockRowsPath*)path;
+						recompute_pathcosts(root, lrpath->subpath, NULL);
+						path->rows = lrpath->subpath->rows;
+						path->startup_cost = lrpath->subpath->startup_cost;
+						path->total_cost = lrpath->subpath->total_cost + cpu_tuple_cost * lrpath->subpath->rows;
+						break;
+				}
 				case T_TidScan:
 						plantype = plantype ? plantype : "TidScan";
 						[[fallthrough]];
@@ -722,12 +1130,6 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 				case T_ValuesScan:
 						plantype = plantype ? plantype : "ValuesScan";
 						[[fallthrough]];
-				case T_ModifyTable:
-						plantype = plantype ? plantype : "ModifyTable";
-						[[fallthrough]];
-				case T_LockRows:
-						plantype = plantype ? plantype : "LockRows";
-						[[fallthrough]];
 				case T_ProjectSet:
 						plantype = plantype ? plantype : "ProjectSet";
 						[[fallthrough]];
@@ -736,11 +1138,192 @@ recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
 						[[fallthrough]];
 				default:
 						plantype = plantype ? plantype : "Unknown";
+						hypocost_counters.unsupported++;
 						ereport(ERROR,
 								(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
 								 errmsg("Unsupported recosting %s", plantype)));
 						break;
 		}
+
+		if (page_costs)
+		{
+				seq_page_cost = saved_seq_page_cost;
+				random_page_cost = saved_random_page_cost;
+		}
+}
+
+
+static PreparedNode*
+prepared_node(PlannerInfo* root, Path* path, Path* outer)
+{
+		bool found;
+		PreparedNode* pn = (PreparedNode*)hash_search(recost_prepared->nodes, &path, HASH_ENTER, &found);
+		if (!found)
+		{
+				// First time seen; the node is still as the first pass left it.
+				memset((char*)pn + sizeof(Path*), 0x00, sizeof(PreparedNode) - sizeof(Path*));
+				pn->root = root;
+				pn->under_bitmap = outer != NULL &&
+						(IsA(outer, BitmapOrPath) || IsA(outer, BitmapAndPath) || IsA(outer, BitmapHeapPath));
+				pn->orig_pathtype = path->pathtype;
+				pn->orig_startup = path->startup_cost;
+				pn->orig_total = path->total_cost;
+				pn->orig_rows = path->rows;
+				if (IsA(path, IndexPath))
+						memcpy(&pn->orig_index, path, sizeof(IndexPath));
+				else if (IsA(path, BitmapHeapPath))
+						pn->orig_bitmapqual = ((BitmapHeapPath*)path)->bitmapqual;
+		}
+		return pn;
+}
+
+
+/*
+ * Whether the node can cost less than one of its inputs, so that a finished
+ * child's total cost says nothing about the root's.
+ */
+static bool
+cost_can_shrink(Path* path)
+{
+		switch (path->pathtype)
+		{
+				case T_Limit:
+				case T_MergeJoin:
+						return true;
+				case T_NestLoop:
+				{
+						JoinPath* jpath = (JoinPath*)path;
+						// Stops scanning the inner side at the first match.
+						return jpath->jointype == JOIN_SEMI || jpath->jointype == JOIN_ANTI || jpath->inner_unique;
+				}
+				case T_Append:
+						return path->parallel_aware;
+				default:
+						return false;
+		}
+}
+
+// Returns false if the node was skipped because its costs are still valid or the recost was pruned.
+static bool
+recompute_pathcosts(PlannerInfo* root, Path* path, Path* outer)
+{
+		int node_id;
+		int parent_id = recost_parent_id;
+		PreparedNode* pn = NULL;
+		bool shrinks;
+
+		if (recost_pruned)
+				return false;
+
+		if (recost_prepared != NULL)
+		{
+				pn = prepared_node(root, path, outer);
+				if (recost_incremental)
+				{
+						// Clean subtrees keep the costs the last recost left in place.
+						if (!pn->dirty)
+								return false;
+
+						if (path->pathtype >= 0 && path->pathtype <= T_Limit)
+								hypocost_counters.nodes_recosted[path->pathtype]++;
+						recost_parent_id = pn->node_id;
+						recompute_node(root, path, outer);
+						recost_parent_id = parent_id;
+						hypocost_whatif_node_rows(pn->node_id, path);
+						return true;
+				}
+
+				// Full recost; remember the tree in visiting order.
+				pn->node_id = recost_next_id;
+				pn->parent_id = parent_id;
+				pn->plan_id = recost_plan_id;
+				pn->parent = parent_id >= 0 ? list_nth(recost_prepared->memo, parent_id) : NULL;
+				Assert(list_length(recost_prepared->memo) == recost_next_id);
+				recost_prepared->memo = lappend(recost_prepared->memo, pn);
+		}
+
+		node_id = recost_next_id++;
+		if (path->pathtype >= 0 && path->pathtype <= T_Limit)
+				hypocost_counters.nodes_recosted[path->pathtype]++;
+
+		if (recost_observer && recost_observer->before)
+				recost_observer->before(node_id, parent_id, recost_plan_id, root, path, recost_observer->context);
+
+		shrinks = cost_can_shrink(path);
+		recost_unbounded += shrinks ? 1 : 0;
+		recost_parent_id = node_id;
+		recompute_node(root, path, outer);
+		hypocost_whatif_node_rows(node_id, path);
+		recost_parent_id = parent_id;
+		recost_unbounded -= shrinks ? 1 : 0;
+
+		// Subplans are charged per call, so only the main tree bounds the root.
+		if (recost_budget >= 0 && recost_unbounded == 0 && recost_plan_id == 0 && !recost_pruned)
+		{
+				recost_bound = Max(recost_bound, path->total_cost);
+				if (recost_bound > recost_budget)
+						recost_pruned = true;
+		}
+
+		if (recost_observer && recost_observer->after)
+				recost_observer->after(node_id, root, path, recost_observer->context);
+		return true;
+}
+
+
+const char* hypocost_pathtype_name(Path* path)
+{
+		return hypocost_plantype_name(path->pathtype);
+}
+
+
+const char* hypocost_plantype_name(NodeTag tag)
+{
+		switch (tag)
+		{
+				case T_SeqScan: return "Seq Scan";
+				case T_SampleScan: return "Sample Scan";
+				case T_IndexScan: return "Index Scan";
+				case T_IndexOnlyScan: return "Index Only Scan";
+				case T_BitmapIndexScan: return "Bitmap Index Scan";
+				case T_BitmapOr: return "BitmapOr";
+				case T_BitmapAnd: return "BitmapAnd";
+				case T_BitmapHeapScan: return "Bitmap Heap Scan";
+				case T_TidScan: return "Tid Scan";
+				case T_TidRangeScan: return "Tid Range Scan";
+				case T_SubqueryScan: return "Subquery Scan";
+				case T_FunctionScan: return "Function Scan";
+				case T_TableFuncScan: return "Table Function Scan";
+				case T_ValuesScan: return "Values Scan";
+				case T_CteScan: return "CTE Scan";
+				case T_NamedTuplestoreScan: return "Named Tuplestore Scan";
+				case T_WorkTableScan: return "WorkTable Scan";
+				case T_ForeignScan: return "Foreign Scan";
+				case T_CustomScan: return "Custom Scan";
+				case T_HashJoin: return "Hash Join";
+				case T_MergeJoin: return "Merge Join";
+				case T_NestLoop: return "Nested Loop";
+				case T_Append: return "Append";
+				case T_MergeAppend: return "Merge Append";
+				case T_Result: return "Result";
+				case T_ProjectSet: return "ProjectSet";
+				case T_Unique: return "Unique";
+				case T_Gather: return "Gather";
+				case T_GatherMerge: return "Gather Merge";
+				case T_Memoize: return "Memoize";
+				case T_Material: return "Materialize";
+				case T_Sort: return "Sort";
+				case T_IncrementalSort: return "Incremental Sort";
+				case T_Group: return "Group";
+				case T_Agg: return "Aggregate";
+				case T_WindowAgg: return "WindowAgg";
+				case T_SetOp: return "SetOp";
+				case T_RecursiveUnion: return "Recursive Union";
+				case T_LockRows: return "LockRows";
+				case T_Limit: return "Limit";
+				case T_ModifyTable: return "ModifyTable";
+				default: return "Unknown";
+		}
 }
 
 
@@ -771,14 +1354,41 @@ SubPlan* hypocost_pick_altsubplan(PlannerInfo* root, List* subpaths)
 }
 
 
-static Plan*
+static void
+finish_subplan(PlannerGlobal* glob, SubPlan* sp, PlannerInfo* subroot, Path* best_path)
+{
+		if (recost_build_plans)
+		{
+				Plan* plan;
+				// The executed plan keeps the workers it was planned with.
+				hypocost_whatif_restore_workers();
+				plan = create_plan(subroot, best_path);
+				list_nth_cell(glob->subplans, sp->plan_id - 1)->ptr_value = plan;
+				cost_subplan(subroot, sp, plan);
+		}
+		else
+		{
+				// cost_subplan() only looks at the node tag, the costs and the rows.
+				// So charge the subplan straight from its path without building it.
+				Plan stub;
+				memset(&stub, 0x00, sizeof(Plan));
+				stub.type = best_path->pathtype;
+				stub.startup_cost = best_path->startup_cost;
+				stub.total_cost = best_path->total_cost;
+				stub.plan_rows = best_path->rows;
+				stub.plan_width = best_path->pathtarget->width;
+				cost_subplan(subroot, sp, &stub);
+		}
+}
+
+static void
 process_subplan(PlannerGlobal* glob, SubPlan* sp)
 {
 		double		tuple_fraction;
 		PlannerInfo *subroot;
 		RelOptInfo *final_rel;
 		Path	   *best_path;
-		Plan* plan;
+		int			plan_id = recost_plan_id;
 		Assert(sp->subLinkType != CTE_SUBLINK);
 		if (sp->subLinkType == EXISTS_SUBLINK)
 				tuple_fraction = 1.0;	/* just like a LIMIT 1 */
@@ -793,21 +1403,23 @@ process_subplan(PlannerGlobal* glob, SubPlan* sp)
 
 		if (!valid_subplan_ids || valid_subplan_ids[sp->plan_id - 1])
 		{
+			recost_plan_id = sp->plan_id;
 			recompute_pathcosts(subroot, best_path, NULL);
+			recost_plan_id = plan_id;
 		}
-		plan = create_plan(subroot, best_path);
-		return plan;
+		finish_subplan(glob, sp, subroot, best_path);
 }
 
-static Plan*
+static void
 process_cte(PlannerGlobal* glob, SubPlan* sp)
 {
 		PlannerInfo *subroot;
 		RelOptInfo *final_rel;
 		Path	   *best_path;
-		Plan* plan;
 		List* nodes;
 		ListCell* lc;
+		int plan_id = recost_plan_id;
+		bool recomputed = true;
 
 		/*
 		 * From the postgres source code in subselect.c:
@@ -823,12 +1435,8 @@ process_cte(PlannerGlobal* glob, SubPlan* sp)
 				Plan* p = (Plan*)lfirst(lc);
 				if (p != NULL && IsA(p, SubPlan))
 				{
-						Plan* plan;
-						PlannerInfo* ssubroot = list_nth(glob->subroots, ((SubPlan*)p)->plan_id - 1);
 						Assert(((SubPlan*)p)->subLinkType != CTE_SUBLINK);
-						plan = process_subplan(glob, (SubPlan*)p);
-						list_nth_cell(glob->subplans, ((SubPlan*)p)->plan_id-1)->ptr_value = plan;
-						cost_subplan(ssubroot, (SubPlan*)p, plan);
+						process_subplan(glob, (SubPlan*)p);
 				}
 		}
 
@@ -837,10 +1445,13 @@ process_cte(PlannerGlobal* glob, SubPlan* sp)
 
 		if (!valid_subplan_ids || valid_subplan_ids[sp->plan_id - 1])
 		{
-			recompute_pathcosts(subroot, best_path, NULL);
+			recost_plan_id = sp->plan_id;
+			recomputed = recompute_pathcosts(subroot, best_path, NULL);
+			recost_plan_id = plan_id;
 		}
 
-		foreach (lc, subroot->init_plans)
+		// A skipped path already carries the init plan charges.
+		foreach (lc, recomputed ? subroot->init_plans : NIL)
 		{
 			SubPlan* isp = (SubPlan*)lfirst(lc);
 			Assert(IsA(lfirst(lc), SubPlan));
@@ -848,8 +1459,7 @@ process_cte(PlannerGlobal* glob, SubPlan* sp)
 			best_path->total_cost += isp->startup_cost + isp->per_call_cost;
 		}
 
-		plan = create_plan(subroot, best_path);
-		return plan;
+		finish_subplan(glob, sp, subroot, best_path);
 }
 
 
@@ -857,11 +1467,45 @@ void hypocost_scribble(PlannerInfo* root, Path* path)
 {
 		List* nodes;
 		ListCell *lc;
+		instr_time start;
+		instr_time duration;
+		bool recomputed;
 		if (!hypocost_do_scribble)
+		{
+				// A planner nested inside ours (SPI from a function being folded, say) also
+				// has parent_root == NULL, so match on the Query we handed to standard_planner.
+				if (capture != NULL && capture->root == NULL && root->parent_root == NULL &&
+						root->parse == capture->parse)
+				{
+						// Keep the final path tree alive so it can be recosted without a second search.
+						capture->root = root;
+						capture->path = path;
+						capture->subplans = copyObject(root->glob->subplans);
+						capture->subroots = list_copy(root->glob->subroots);
+						capture->init_plans = list_copy(root->init_plans);
+						capture->nparamexec = list_length(root->glob->paramExecTypes);
+						capture->rewind_plan_ids = bms_copy(root->glob->rewindPlanIDs);
+				}
 				return;
+		}
 
 		// Wire for re-costing.
 		wire_state();
+		INSTR_TIME_SET_CURRENT(start);
+
+		if (root->parent_root == NULL)
+		{
+				// Fresh top-level recost; number the nodes from scratch.
+				recost_next_id = 0;
+				recost_parent_id = -1;
+				recost_plan_id = 0;
+				recost_bound = 0;
+				recost_unbounded = 0;
+				recost_pruned = false;
+				recost_parallel_workers = -1;
+				hypocost_counters.recosts++;
+				hypocost_whatif_apply(root, recost_query_string);
+		}
 
 		nodes = list_concat_copy(root->init_plans, root->noninit_plans);
 		foreach (lc, nodes)
@@ -869,47 +1513,54 @@ void hypocost_scribble(PlannerInfo* root, Path* path)
 			Plan* p = (Plan*)lfirst(lc);
 			if (p != NULL && IsA(p, SubPlan))
 			{
-				Plan* plan;
-				PlannerInfo* subroot = list_nth(root->glob->subroots, ((SubPlan*)p)->plan_id - 1);
 				if (((SubPlan*)p)->subLinkType == CTE_SUBLINK)
-					plan = process_cte(root->glob, (SubPlan*)p);
+					process_cte(root->glob, (SubPlan*)p);
 				else
-					plan = process_subplan(root->glob, (SubPlan*)p);
-				list_nth_cell(root->glob->subplans, ((SubPlan*)p)->plan_id-1)->ptr_value = plan;
-				cost_subplan(subroot, (SubPlan*)p, plan);
+					process_subplan(root->glob, (SubPlan*)p);
 			}
 		}
 
 		// Recompute the main.
-		recompute_pathcosts(root, path, NULL);
+		recomputed = recompute_pathcosts(root, path, NULL);
 
 		// We need to do something similar to charge for init plans...
 		// See: SS_charge_for_initplans.
-		foreach (lc, root->init_plans)
+		foreach (lc, recomputed ? root->init_plans : NIL)
 		{
 			SubPlan* isp = (SubPlan*)lfirst(lc);
 			Assert(IsA(lfirst(lc), SubPlan));
 			path->startup_cost += isp->startup_cost + isp->per_call_cost;
 			path->total_cost += isp->startup_cost + isp->per_call_cost;
 		}
+
+		// The plan about to be built is executed with the workers it was planned with.
+		if (recost_build_plans && root->parent_root == NULL)
+				hypocost_whatif_restore_workers();
+
+		INSTR_TIME_SET_CURRENT(duration);
+		INSTR_TIME_SUBTRACT(duration, start);
+		hypocost_counters.recost_time += INSTR_TIME_GET_MILLISEC(duration);
 }
 
 
-PlannedStmt* hypocost_planner(Query *parse, const char* query_string, int cursorOptions, ParamListInfo boundParams)
+static void
+release_valid_subplans(void)
 {
-		PlannedStmt* result = NULL;
-		Query* cparse = NULL;
-		ListCell* lc = NULL;
-		if (!hypocost_enable)
+		if (valid_subplan_ids)
 		{
-				return standard_planner(parse, query_string, cursorOptions, boundParams);
+				MemoryContext old = MemoryContextSwitchTo(TopMemoryContext);
+				pfree(valid_subplan_ids);
+				valid_subplan_ids = NULL;
+				valid_subplan_ids_len = 0;
+				MemoryContextSwitchTo(old);
 		}
+}
 
-		// Copy the global state.
-		original_guc = save_state();
-
-		cparse = copyObject(parse);
-		result = standard_planner(parse, query_string, cursorOptions, boundParams);
+static void
+stash_valid_subplans(PlannedStmt* result)
+{
+		ListCell* lc = NULL;
+		release_valid_subplans();
 		if (result->subplans)
 		{
 				// Stash which subplan IDs are actually valid.
@@ -926,6 +1577,563 @@ PlannedStmt* hypocost_planner(Query *parse, const char* query_string, int cursor
 						}
 				}
 		}
+}
+
+
+/*
+ * Recost the captured first-pass path tree in place and turn it into a new
+ * PlannedStmt. This mirrors the tail of standard_planner().
+ */
+static PlannedStmt*
+hypocost_replan(struct HypocostCapture* cap, int cursorOptions)
+{
+		PlannerInfo* root = cap->root;
+		PlannerGlobal* glob = root->glob;
+		Query* parse = root->parse;
+		PlannedStmt* result;
+		Plan* top_plan;
+		ListCell* lp;
+		ListCell* lr;
+
+		// Rewind everything that create_plan() and set_plan_references() accumulate.
+		glob->subplans = cap->subplans;
+		glob->subroots = cap->subroots;
+		root->init_plans = cap->init_plans;
+		glob->paramExecTypes = list_truncate(list_copy(glob->paramExecTypes), cap->nparamexec);
+		glob->rewindPlanIDs = bms_copy(cap->rewind_plan_ids);
+		glob->finalrtable = NIL;
+		glob->finalrowmarks = NIL;
+		glob->resultRelations = NIL;
+		glob->appendRelations = NIL;
+		glob->relationOids = NIL;
+		glob->invalItems = NIL;
+		glob->lastPlanNodeId = 0;
+
+		hypocost_scribble(root, cap->path);
+		top_plan = create_plan(root, cap->path);
+
+		if (cursorOptions & CURSOR_OPT_SCROLL)
+		{
+				if (!ExecSupportsBackwardScan(top_plan))
+						top_plan = materialize_finished_plan(top_plan);
+		}
+
+		if (glob->paramExecTypes != NIL)
+		{
+				Assert(list_length(glob->subplans) == list_length(glob->subroots));
+				forboth(lp, glob->subplans, lr, glob->subroots)
+				{
+						Plan* subplan = (Plan*)lfirst(lp);
+						PlannerInfo* subroot = lfirst_node(PlannerInfo, lr);
+						SS_finalize_plan(subroot, subplan);
+				}
+				SS_finalize_plan(root, top_plan);
+		}
+
+		top_plan = set_plan_references(root, top_plan);
+		Assert(list_length(glob->subplans) == list_length(glob->subroots));
+		forboth(lp, glob->subplans, lr, glob->subroots)
+		{
+				Plan* subplan = (Plan*)lfirst(lp);
+				PlannerInfo* subroot = lfirst_node(PlannerInfo, lr);
+				lfirst(lp) = set_plan_references(subroot, subplan);
+		}
+
+		result = makeNode(PlannedStmt);
+		result->commandType = parse->commandType;
+		result->queryId = parse->queryId;
+		result->hasReturning = (parse->returningList != NIL);
+		result->hasModifyingCTE = parse->hasModifyingCTE;
+		result->canSetTag = parse->canSetTag;
+		result->transientPlan = glob->transientPlan;
+		result->dependsOnRole = glob->dependsOnRole;
+		result->parallelModeNeeded = glob->parallelModeNeeded;
+		result->planTree = top_plan;
+		result->rtable = glob->finalrtable;
+		result->resultRelations = glob->resultRelations;
+		result->appendRelations = glob->appendRelations;
+		result->subplans = glob->subplans;
+		result->rewindPlanIDs = glob->rewindPlanIDs;
+		result->rowMarks = glob->finalrowmarks;
+		result->relationOids = glob->relationOids;
+		result->invalItems = glob->invalItems;
+		result->paramExecTypes = glob->paramExecTypes;
+		result->utilityStmt = parse->utilityStmt;
+		result->stmt_location = parse->stmt_location;
+		result->stmt_len = parse->stmt_len;
+
+		result->jitFlags = PGJIT_NONE;
+		if (jit_enabled && jit_above_cost >= 0 && top_plan->total_cost > jit_above_cost)
+		{
+				result->jitFlags |= PGJIT_PERFORM;
+				if (jit_optimize_above_cost >= 0 && top_plan->total_cost > jit_optimize_above_cost)
+						result->jitFlags |= PGJIT_OPT3;
+				if (jit_inline_above_cost >= 0 && top_plan->total_cost > jit_inline_above_cost)
+						result->jitFlags |= PGJIT_INLINE;
+				if (jit_expressions)
+						result->jitFlags |= PGJIT_EXPR;
+				if (jit_tuple_deforming)
+						result->jitFlags |= PGJIT_DEFORM;
+		}
+
+		return result;
+}
+
+
+static bool
+has_marker_comment(const char* query_string)
+{
+		const char* c = query_string;
+		while ((c = strstr(c, "/*")) != NULL)
+		{
+				c += 2;
+				while (*c == ' ' || *c == '\t' || *c == '\n')
+						c++;
+
+				if (strncmp(c, "hypocost", 8) == 0)
+				{
+						c += 8;
+						while (*c == ' ' || *c == '\t' || *c == '\n')
+								c++;
+
+						if (strncmp(c, "*/", 2) == 0)
+								return true;
+				}
+		}
+		return false;
+}
+
+
+bool hypocost_activated(const char* query_string)
+{
+		switch (hypocost_activation)
+		{
+				case HYPOCOST_ACTIVATE_EXPLAIN:
+						return hypocost_in_explain;
+				case HYPOCOST_ACTIVATE_COMMENT:
+						return query_string != NULL && has_marker_comment(query_string);
+				case HYPOCOST_ACTIVATE_ALWAYS:
+				default:
+						return true;
+		}
+}
+
+
+struct HypocostCapture*
+hypocost_capture(Query* parse, const char* query_string, int cursorOptions, ParamListInfo boundParams)
+{
+		struct HypocostCapture* cap = palloc0(sizeof(struct HypocostCapture));
+		instr_time start;
+		instr_time duration;
+
+		// Copy the global state.
+		original_guc = save_state();
+		hypocost_stats_begin(parse->queryId);
+		INSTR_TIME_SET_CURRENT(start);
+		PG_TRY();
+		{
+				cap->parse = parse;
+				cap->query_string = query_string != NULL ? pstrdup(query_string) : NULL;
+				capture = cap;
+				cap->plan = standard_planner(parse, query_string, cursorOptions, boundParams);
+		}
+		PG_FINALLY();
+		{
+				capture = NULL;
+		}
+		PG_END_TRY();
+
+		INSTR_TIME_SET_CURRENT(duration);
+		INSTR_TIME_SUBTRACT(duration, start);
+		hypocost_counters.first_pass_time += INSTR_TIME_GET_MILLISEC(duration);
+
+		if (cap->root == NULL)
+				elog(ERROR, "hypocost failed to capture the planned path");
+
+		stash_valid_subplans(cap->plan);
+		return cap;
+}
+
+/*
+ * Plan from scratch under the settings a recost is wired with, for
+ * comparing the preserved shape against what the optimizer would pick.
+ */
+PlannedStmt*
+hypocost_plan_unconstrained(Query* parse, const char* query_string, int cursorOptions)
+{
+		struct GUCState saved = save_state();
+		PlannedStmt* result = NULL;
+		PG_TRY();
+		{
+				wire_state();
+				result = standard_planner(parse, query_string, cursorOptions, NULL);
+		}
+		PG_FINALLY();
+		{
+				restore_state(saved);
+		}
+		PG_END_TRY();
+		return result;
+}
+
+void
+hypocost_recost(struct HypocostCapture* cap, HypocostObserver* observer)
+{
+		hypocost_recost_bounded(cap, observer, -1, NULL);
+}
+
+/*
+ * Recost, giving up once the root's total cost is known to exceed budget
+ * (negative for no budget). Returns true if the recost was pruned; the costs
+ * left in the tree are then meaningless and *bound holds the lower bound that
+ * passed the budget.
+ */
+bool
+hypocost_recost_bounded(struct HypocostCapture* cap, HypocostObserver* observer, double budget, Cost* bound)
+{
+		Size mem = MemoryContextMemAllocated(CurrentMemoryContext, true);
+		bool pruned = false;
+		PG_TRY();
+		{
+				hypocost_do_scribble = true;
+				recost_build_plans = false;
+				recost_observer = observer;
+				recost_budget = budget;
+				recost_query_string = cap->query_string;
+				hypocost_scribble(cap->root, cap->path);
+				pruned = recost_pruned;
+				if (bound != NULL)
+						*bound = recost_bound;
+		}
+		PG_FINALLY();
+		{
+				hypocost_do_scribble = false;
+				recost_build_plans = true;
+				recost_observer = NULL;
+				recost_budget = -1;
+				recost_pruned = false;
+				recost_query_string = NULL;
+				restore_state(original_guc);
+		}
+		PG_END_TRY();
+
+		hypocost_counters.mem_allocated += Max((int64)MemoryContextMemAllocated(CurrentMemoryContext, true) - (int64)mem, 0);
+		return pruned;
+}
+
+/*
+ * Put back the scans that substitutions rewrote, so that the captured tree can
+ * be recosted under other settings as if for the first time.
+ */
+void
+hypocost_undo_substitutions(void)
+{
+		int i;
+
+		for (i = list_length(substitutions) - 1; i >= 0; i--)
+		{
+				SubstitutionUndo* undo = (SubstitutionUndo*)list_nth(substitutions, i);
+				if (undo->ipath != NULL)
+						memcpy(undo->ipath, &undo->orig_index, sizeof(IndexPath));
+				else
+						*undo->bitmapqual = undo->orig_bitmapqual;
+		}
+		list_free_deep(substitutions);
+		substitutions = NIL;
+}
+
+void
+hypocost_release(void)
+{
+		// The substituted tree is what gets planned and kept; only forget how to undo it.
+		list_free_deep(substitutions);
+		substitutions = NIL;
+		release_valid_subplans();
+		hypocost_whatif_restore();
+		recost_query_string = NULL;
+		hypocost_end_cycle();
+		restore_state(original_guc);
+		hypocost_stats_flush();
+}
+
+
+void
+hypocost_prepared_capture(HypocostPrepared* prep)
+{
+		MemoryContext old;
+		HASHCTL ctl;
+
+		MemoryContextReset(prep->cxt);
+		prep->cap = NULL;
+		prep->nodes = NULL;
+		prep->memo = NIL;
+		prep->recosted = false;
+		prep->stale = false;
+
+		old = MemoryContextSwitchTo(prep->cxt);
+		PG_TRY();
+		{
+				Query* parse = hypocost_parse_query(prep->query_string);
+				struct HypocostCapture* cap = hypocost_capture(parse, prep->query_string, CURSOR_OPT_PARALLEL_OK, NULL);
+				prep->guc = palloc(sizeof(struct GUCState));
+				*prep->guc = original_guc;
+				prep->live_hash = settings_hash(false);
+
+				prep->valid_subplan_ids_len = valid_subplan_ids_len;
+				prep->valid_subplan_ids = NULL;
+				if (valid_subplan_ids)
+				{
+						prep->valid_subplan_ids = palloc(sizeof(int) * valid_subplan_ids_len);
+						memcpy(prep->valid_subplan_ids, valid_subplan_ids, sizeof(int) * valid_subplan_ids_len);
+				}
+
+				ctl.keysize = sizeof(Path*);
+				ctl.entrysize = sizeof(PreparedNode);
+				ctl.hcxt = prep->cxt;
+				prep->nodes = hash_create("hypocost prepared nodes", 256, &ctl, HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+				// Only a complete capture can be recosted.
+				prep->cap = cap;
+		}
+		PG_FINALLY();
+		{
+				MemoryContextSwitchTo(old);
+				hypocost_release();
+		}
+		PG_END_TRY();
+}
+
+
+static uint32
+bitmap_signature(Path* path)
+{
+		ListCell* lc;
+		uint32 hash = 0;
+
+		if (IsA(path, IndexPath))
+				return hypocost_match_signature(((IndexPath*)path)->indexinfo->indexoid);
+
+		if (IsA(path, BitmapAndPath) || IsA(path, BitmapOrPath))
+		{
+				List* quals = IsA(path, BitmapAndPath) ? ((BitmapAndPath*)path)->bitmapquals : ((BitmapOrPath*)path)->bitmapquals;
+				foreach(lc, quals)
+						hash = hash_combine(hash, bitmap_signature(lfirst(lc)));
+		}
+		return hash;
+}
+
+static uint32
+node_signature(PreparedNode* pn)
+{
+		switch (pn->orig_pathtype)
+		{
+				case T_IndexScan:
+				case T_IndexOnlyScan:
+						// Bitmap index scans are substituted through their heap scan.
+						if (pn->under_bitmap)
+								return 0;
+						return hypocost_match_signature(pn->orig_index.indexinfo->indexoid);
+				case T_BitmapHeapScan:
+						return bitmap_signature(pn->orig_bitmapqual);
+				default:
+						return 0;
+		}
+}
+
+// Put every node back the way the first pass left it.
+static void
+prepared_restore(HypocostPrepared* prep)
+{
+		HASH_SEQ_STATUS status;
+		PreparedNode* pn;
+
+		hash_seq_init(&status, prep->nodes);
+		while ((pn = hash_seq_search(&status)) != NULL)
+		{
+				if (IsA(pn->path, IndexPath))
+						memcpy(pn->path, &pn->orig_index, sizeof(IndexPath));
+				else if (IsA(pn->path, BitmapHeapPath))
+						((BitmapHeapPath*)pn->path)->bitmapqual = pn->orig_bitmapqual;
+		}
+}
+
+/*
+ * Marks the scans whose substitution changed since the last recost, and
+ * their ancestors, as needing a recost. Returns true if the whole tree has
+ * to be recosted instead.
+ */
+static bool
+prepared_mark_dirty(HypocostPrepared* prep)
+{
+		ListCell* lc;
+
+		// Rows injected into a clean subtree have to reach the relations the joins above are sized from.
+		if (!prep->recosted || hypocost_settings_hash() != prep->settings_hash ||
+			hypocost_whatif_has_node_rows(prep->query_string))
+				return true;
+
+		foreach(lc, prep->memo)
+				((PreparedNode*)lfirst(lc))->dirty = false;
+
+		foreach(lc, prep->memo)
+		{
+				PreparedNode* pn = (PreparedNode*)lfirst(lc);
+				PreparedNode* p;
+				if (node_signature(pn) == pn->signature)
+						continue;
+
+				// A bitmap substitution reshapes the tree, and a subplan's cost is
+				// folded into the quals of whichever node references it.
+				if (pn->orig_pathtype == T_BitmapHeapScan || pn->plan_id != 0)
+						return true;
+
+				memcpy(pn->path, &pn->orig_index, sizeof(IndexPath));
+				for (p = pn; p != NULL && !p->dirty; p = p->parent)
+						p->dirty = true;
+		}
+		return false;
+}
+
+static HypocostResult*
+prepared_result(HypocostPrepared* prep)
+{
+		HypocostResult* result = palloc0(sizeof(HypocostResult));
+		ListCell* lc;
+
+		result->startup = prep->cap->path->startup_cost;
+		result->total = prep->cap->path->total_cost;
+		result->rows = prep->cap->path->rows;
+		result->nnodes = list_length(prep->memo);
+		result->nodes = palloc0(sizeof(NodeCost) * Max(result->nnodes, 1));
+		foreach(lc, prep->memo)
+		{
+				PreparedNode* pn = (PreparedNode*)lfirst(lc);
+				NodeCost* nc = &result->nodes[foreach_current_index(lc)];
+				nc->node_id = pn->node_id;
+				nc->parent_id = pn->parent_id;
+				nc->plan_id = pn->plan_id;
+				nc->pathtype = pn->path->pathtype;
+				nc->relid = hypocost_path_relid(pn->root, pn->path);
+				if (IsA(pn->path, IndexPath))
+						nc->indexoid = ((IndexPath*)pn->path)->indexinfo->indexoid;
+				nc->orig_startup = pn->orig_startup;
+				nc->orig_total = pn->orig_total;
+				nc->orig_rows = pn->orig_rows;
+				nc->startup = pn->path->startup_cost;
+				nc->total = pn->path->total_cost;
+				nc->rows = pn->path->rows;
+		}
+		return result;
+}
+
+HypocostResult*
+hypocost_recost_prepared(HypocostPrepared* prep)
+{
+		MemoryContext old;
+		ListCell* lc;
+		Size mem;
+
+		// The planner expects the relations to be locked, but the locks went with the transaction.
+		if (prep->cap != NULL)
+		{
+				foreach(lc, prep->cap->plan->relationOids)
+						LockRelationOid(lfirst_oid(lc), AccessShareLock);
+		}
+
+		// Locking processes pending invalidations. A first pass under other planner settings, any that
+		// EXPLAIN (SETTINGS) would report, is of no use either.
+		if (prep->cap == NULL || prep->stale || settings_hash(false) != prep->live_hash)
+				hypocost_prepared_capture(prep);
+
+		original_guc = *prep->guc;
+		release_valid_subplans();
+		if (prep->valid_subplan_ids)
+		{
+				valid_subplan_ids_len = prep->valid_subplan_ids_len;
+				valid_subplan_ids = MemoryContextAlloc(TopMemoryContext, sizeof(int) * valid_subplan_ids_len);
+				memcpy(valid_subplan_ids, prep->valid_subplan_ids, sizeof(int) * valid_subplan_ids_len);
+		}
+		hypocost_stats_begin(prep->cap->plan->queryId);
+
+		// Substituted paths are built in the current context and have to outlive the call.
+		mem = MemoryContextMemAllocated(prep->cxt, true);
+		old = MemoryContextSwitchTo(prep->cxt);
+		PG_TRY();
+		{
+				recost_incremental = !prepared_mark_dirty(prep);
+				if (!recost_incremental)
+				{
+						prepared_restore(prep);
+						prep->memo = NIL;
+				}
+
+				// Half-recosted trees can only be recovered by a full recost.
+				prep->recosted = false;
+				hypocost_do_scribble = true;
+				recost_build_plans = false;
+				recost_prepared = prep;
+				recost_query_string = prep->query_string;
+				hypocost_scribble(prep->cap->root, prep->cap->path);
+
+				foreach(lc, prep->memo)
+				{
+						PreparedNode* pn = (PreparedNode*)lfirst(lc);
+						pn->signature = node_signature(pn);
+						pn->dirty = false;
+				}
+				prep->settings_hash = hypocost_settings_hash();
+				prep->recosted = true;
+		}
+		PG_FINALLY();
+		{
+				hypocost_do_scribble = false;
+				recost_build_plans = true;
+				recost_prepared = NULL;
+				recost_incremental = false;
+				MemoryContextSwitchTo(old);
+				hypocost_counters.mem_allocated += Max((int64)MemoryContextMemAllocated(prep->cxt, true) - (int64)mem, 0);
+				hypocost_release();
+		}
+		PG_END_TRY();
+
+		return prepared_result(prep);
+}
+
+
+PlannedStmt* hypocost_planner(Query *parse, const char* query_string, int cursorOptions, ParamListInfo boundParams)
+{
+		PlannedStmt* result = NULL;
+		Query* cparse = NULL;
+		struct HypocostCapture* cap = NULL;
+		bool single_pass;
+		instr_time start;
+		instr_time duration;
+		Size mem;
+		if (!hypocost_enable || !hypocost_activated(query_string))
+		{
+				return standard_planner(parse, query_string, cursorOptions, boundParams);
+		}
+
+		// force_parallel_mode injects a Gather on top that we don't reproduce.
+		single_pass = hypocost_single_pass && force_parallel_mode == FORCE_PARALLEL_OFF;
+		if (single_pass)
+		{
+				cap = hypocost_capture(parse, query_string, cursorOptions, boundParams);
+				result = cap->plan;
+		}
+		else
+		{
+				// Copy the global state.
+				original_guc = save_state();
+				hypocost_stats_begin(parse->queryId);
+				cparse = copyObject(parse);
+				INSTR_TIME_SET_CURRENT(start);
+				result = standard_planner(parse, query_string, cursorOptions, boundParams);
+				INSTR_TIME_SET_CURRENT(duration);
+				INSTR_TIME_SUBTRACT(duration, start);
+				hypocost_counters.first_pass_time += INSTR_TIME_GET_MILLISEC(duration);
+				stash_valid_subplans(result);
+		}
 
 		if (es_ctx != NULL)
 		{
@@ -946,22 +2154,24 @@ PlannedStmt* hypocost_planner(Query *parse, const char* query_string, int cursor
 
 		// Time to scribble...
 		hypocost_do_scribble = true;
+		recost_query_string = query_string;
+		mem = MemoryContextMemAllocated(CurrentMemoryContext, true);
+		INSTR_TIME_SET_CURRENT(start);
 		PG_TRY();
 		{
-				result = standard_planner(cparse, query_string, cursorOptions, boundParams);
+				if (single_pass)
+						result = hypocost_replan(cap, cursorOptions);
+				else
+						result = standard_planner(cparse, query_string, cursorOptions, boundParams);
 		}
 		PG_FINALLY();
 		{
 				hypocost_do_scribble = false;
-				if (valid_subplan_ids)
-				{
-						MemoryContext old = MemoryContextSwitchTo(TopMemoryContext);
-						pfree(valid_subplan_ids);
-						valid_subplan_ids = NULL;
-						valid_subplan_ids_len = 0;
-						MemoryContextSwitchTo(old);
-				}
-				restore_state(original_guc);
+				INSTR_TIME_SET_CURRENT(duration);
+				INSTR_TIME_SUBTRACT(duration, start);
+				hypocost_counters.second_pass_time += INSTR_TIME_GET_MILLISEC(duration);
+				hypocost_counters.mem_allocated += Max((int64)MemoryContextMemAllocated(CurrentMemoryContext, true) - (int64)mem, 0);
+				hypocost_release();
 		}
 		PG_END_TRY();
 		return result;
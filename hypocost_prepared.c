@@ -0,0 +1,100 @@
+#include "postgres.h"
+#include "fmgr.h"
+#include "utils/builtins.h"
+#include "utils/inval.h"
+#include "utils/memutils.h"
+
+#include "hypocost.h"
+
+PG_FUNCTION_INFO_V1(hypocost_prepare);
+PG_FUNCTION_INFO_V1(hypocost_deallocate);
+
+/*
+ * Statements captured by hypocost_prepare(), kept until hypocost_deallocate()
+ * or the end of the session.
+ */
+static List* prepared = NIL;
+static int prepared_next_id = 1;
+static bool callback_registered = false;
+
+static void
+prepared_relcache_callback(Datum arg, Oid relid)
+{
+	ListCell* lc;
+
+	foreach(lc, prepared)
+	{
+		HypocostPrepared* prep = (HypocostPrepared*)lfirst(lc);
+		if (prep->stale || prep->cap == NULL)
+			continue;
+
+		if (!OidIsValid(relid) || list_member_oid(prep->cap->plan->relationOids, relid))
+			prep->stale = true;
+	}
+}
+
+HypocostPrepared*
+hypocost_prepared_lookup(int id)
+{
+	ListCell* lc;
+
+	foreach(lc, prepared)
+	{
+		HypocostPrepared* prep = (HypocostPrepared*)lfirst(lc);
+		if (prep->id == id)
+			return prep;
+	}
+
+	ereport(ERROR,
+			(errcode(ERRCODE_UNDEFINED_OBJECT),
+			 errmsg("hypocost prepared statement %d does not exist", id)));
+	return NULL;
+}
+
+Datum
+hypocost_prepare(PG_FUNCTION_ARGS)
+{
+	char* query_string = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	HypocostPrepared* prep;
+	MemoryContext oldcontext;
+
+	if (!callback_registered)
+	{
+		CacheRegisterRelcacheCallback(prepared_relcache_callback, (Datum) 0);
+		callback_registered = true;
+	}
+
+	prep = MemoryContextAllocZero(TopMemoryContext, sizeof(HypocostPrepared));
+	prep->query_string = MemoryContextStrdup(TopMemoryContext, query_string);
+	prep->cxt = AllocSetContextCreate(TopMemoryContext, "hypocost prepared", ALLOCSET_DEFAULT_SIZES);
+	PG_TRY();
+	{
+		hypocost_prepared_capture(prep);
+	}
+	PG_CATCH();
+	{
+		MemoryContextDelete(prep->cxt);
+		pfree(prep->query_string);
+		pfree(prep);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	prep->id = prepared_next_id++;
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	prepared = lappend(prepared, prep);
+	MemoryContextSwitchTo(oldcontext);
+	PG_RETURN_INT32(prep->id);
+}
+
+Datum
+hypocost_deallocate(PG_FUNCTION_ARGS)
+{
+	HypocostPrepared* prep = hypocost_prepared_lookup(PG_GETARG_INT32(0));
+
+	prepared = list_delete_ptr(prepared, prep);
+	MemoryContextDelete(prep->cxt);
+	pfree(prep->query_string);
+	pfree(prep);
+	PG_RETURN_VOID();
+}
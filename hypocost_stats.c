@@ -0,0 +1,308 @@
+#include "postgres.h"
+#include "fmgr.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/queryjumble.h"
+#include "utils/tuplestore.h"
+
+#include "hypocost.h"
+
+PG_FUNCTION_INFO_V1(hypocost_stats);
+PG_FUNCTION_INFO_V1(hypocost_stat_reset);
+PG_FUNCTION_INFO_V1(hypocost_stat_info);
+
+#define HYPOCOST_STATS_COLS 11
+
+/* Eviction policy, as in pg_stat_statements */
+#define USAGE_INIT 1.0
+#define USAGE_DECREASE_FACTOR 0.99
+#define USAGE_DEALLOC_PERCENT 5
+
+/* Statistics are kept per database and query fingerprint */
+typedef struct HypocostStatsKey
+{
+	Oid dbid;
+	uint64 queryid;
+} HypocostStatsKey;
+
+typedef struct HypocostStatsEntry
+{
+	HypocostStatsKey key;
+	HypocostCounters counters;
+	// Number of recosts, decayed on every eviction pass.
+	double usage;
+} HypocostStatsEntry;
+
+typedef struct HypocostStatsShared
+{
+	LWLock* lock;
+	// Eviction passes since the last reset.
+	int64 dealloc;
+} HypocostStatsShared;
+
+/* Work done for the statement currently being recosted by this backend */
+HypocostCounters hypocost_counters;
+
+static bool stats_active = false;
+static uint64 stats_queryid = 0;
+
+static HypocostStatsShared* stats_shared = NULL;
+static HTAB* stats_hash = NULL;
+
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static Size
+stats_memsize(void)
+{
+	return add_size(MAXALIGN(sizeof(HypocostStatsShared)),
+					hash_estimate_size(hypocost_stats_max, sizeof(HypocostStatsEntry)));
+}
+
+static void
+stats_shmem_request(void)
+{
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+
+	RequestAddinShmemSpace(stats_memsize());
+	RequestNamedLWLockTranche("hypocost", 1);
+}
+
+static void
+stats_shmem_startup(void)
+{
+	HASHCTL info;
+	bool found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	stats_shared = NULL;
+	stats_hash = NULL;
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	stats_shared = ShmemInitStruct("hypocost stats", sizeof(HypocostStatsShared), &found);
+	if (!found)
+	{
+		stats_shared->lock = &(GetNamedLWLockTranche("hypocost"))->lock;
+		stats_shared->dealloc = 0;
+	}
+
+	info.keysize = sizeof(HypocostStatsKey);
+	info.entrysize = sizeof(HypocostStatsEntry);
+	stats_hash = ShmemInitHash("hypocost stats hash", hypocost_stats_max, hypocost_stats_max, &info, HASH_ELEM | HASH_BLOBS);
+	LWLockRelease(AddinShmemInitLock);
+}
+
+void
+hypocost_stats_init(void)
+{
+	// The shared statistics only exist when loaded through shared_preload_libraries.
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+	// Statistics are keyed by the query fingerprint.
+	EnableQueryId();
+
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = stats_shmem_request;
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = stats_shmem_startup;
+}
+
+static int
+usage_cmp(const void* a, const void* b)
+{
+	double l = (*(HypocostStatsEntry* const*)a)->usage;
+	double r = (*(HypocostStatsEntry* const*)b)->usage;
+
+	if (l < r)
+		return -1;
+	if (l > r)
+		return 1;
+	return 0;
+}
+
+/*
+ * Make room for new statements by removing the least recosted ones. As in
+ * pg_stat_statements, every entry's usage decays on each pass so that
+ * statements which stopped running eventually go. Caller holds the lock
+ * exclusively.
+ */
+static void
+stats_dealloc(void)
+{
+	HASH_SEQ_STATUS status;
+	HypocostStatsEntry** entries;
+	HypocostStatsEntry* entry;
+	int nvictims;
+	int i = 0;
+
+	entries = palloc(hash_get_num_entries(stats_hash) * sizeof(HypocostStatsEntry*));
+
+	hash_seq_init(&status, stats_hash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		entries[i++] = entry;
+		entry->usage *= USAGE_DECREASE_FACTOR;
+	}
+
+	qsort(entries, i, sizeof(HypocostStatsEntry*), usage_cmp);
+
+	nvictims = Max(10, i * USAGE_DEALLOC_PERCENT / 100);
+	nvictims = Min(nvictims, i);
+
+	for (i = 0; i < nvictims; i++)
+		hash_search(stats_hash, &entries[i]->key, HASH_REMOVE, NULL);
+
+	pfree(entries);
+	stats_shared->dealloc++;
+}
+
+void
+hypocost_stats_begin(uint64 queryid)
+{
+	memset(&hypocost_counters, 0x00, sizeof(HypocostCounters));
+	stats_queryid = queryid;
+	stats_active = true;
+}
+
+void
+hypocost_stats_flush(void)
+{
+	HypocostStatsKey key;
+	HypocostStatsEntry* entry;
+	HypocostCounters* c;
+	bool found;
+
+	if (!stats_active)
+		return;
+	stats_active = false;
+
+	if (stats_shared == NULL || stats_hash == NULL)
+		return;
+
+	// Zero the padding since the key is hashed as a blob.
+	memset(&key, 0x00, sizeof(HypocostStatsKey));
+	key.dbid = MyDatabaseId;
+	key.queryid = stats_queryid;
+
+	LWLockAcquire(stats_shared->lock, LW_EXCLUSIVE);
+	entry = (HypocostStatsEntry*)hash_search(stats_hash, &key, HASH_FIND, NULL);
+	if (entry == NULL)
+	{
+		// Out of tracked statements; evict the least used ones first.
+		if (hash_get_num_entries(stats_hash) >= hypocost_stats_max)
+			stats_dealloc();
+
+		entry = (HypocostStatsEntry*)hash_search(stats_hash, &key, HASH_ENTER_NULL, &found);
+		if (entry == NULL)
+		{
+			LWLockRelease(stats_shared->lock);
+			return;
+		}
+		memset(&entry->counters, 0x00, sizeof(HypocostCounters));
+		entry->usage = USAGE_INIT;
+	}
+	else
+		entry->usage += 1.0;
+
+	c = &entry->counters;
+
+	c->recosts += hypocost_counters.recosts;
+	c->first_pass_time += hypocost_counters.first_pass_time;
+	c->second_pass_time += hypocost_counters.second_pass_time;
+	c->recost_time += hypocost_counters.recost_time;
+	c->subst_attempted += hypocost_counters.subst_attempted;
+	c->subst_succeeded += hypocost_counters.subst_succeeded;
+	c->subst_degraded += hypocost_counters.subst_degraded;
+	c->unsupported += hypocost_counters.unsupported;
+	c->mem_allocated += hypocost_counters.mem_allocated;
+	LWLockRelease(stats_shared->lock);
+}
+
+static void
+check_stats_available(void)
+{
+	if (stats_shared == NULL || stats_hash == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("hypocost statistics require hypocost in shared_preload_libraries")));
+}
+
+Datum
+hypocost_stats(PG_FUNCTION_ARGS)
+{
+	Tuplestorestate *tupstore;
+	TupleDesc tupdesc;
+	HASH_SEQ_STATUS status;
+	HypocostStatsEntry* entry;
+
+	check_stats_available();
+	tupstore = hypocost_init_srf(fcinfo, &tupdesc);
+
+	LWLockAcquire(stats_shared->lock, LW_SHARED);
+	hash_seq_init(&status, stats_hash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+	{
+		HypocostCounters* c = &entry->counters;
+		Datum values[HYPOCOST_STATS_COLS];
+		bool nulls[HYPOCOST_STATS_COLS];
+
+		memset(nulls, 0, sizeof(nulls));
+		values[0] = ObjectIdGetDatum(entry->key.dbid);
+		values[1] = Int64GetDatum((int64)entry->key.queryid);
+		values[2] = Int64GetDatum(c->recosts);
+		values[3] = Float8GetDatum(c->first_pass_time);
+		values[4] = Float8GetDatum(c->second_pass_time);
+		values[5] = Float8GetDatum(c->recost_time);
+		values[6] = Int64GetDatum(c->subst_attempted);
+		values[7] = Int64GetDatum(c->subst_succeeded);
+		values[8] = Int64GetDatum(c->subst_degraded);
+		values[9] = Int64GetDatum(c->unsupported);
+		values[10] = Int64GetDatum(c->mem_allocated);
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+	}
+	LWLockRelease(stats_shared->lock);
+
+	return (Datum) 0;
+}
+
+Datum
+hypocost_stat_reset(PG_FUNCTION_ARGS)
+{
+	HASH_SEQ_STATUS status;
+	HypocostStatsEntry* entry;
+
+	check_stats_available();
+
+	LWLockAcquire(stats_shared->lock, LW_EXCLUSIVE);
+	hash_seq_init(&status, stats_hash);
+	while ((entry = hash_seq_search(&status)) != NULL)
+		hash_search(stats_hash, &entry->key, HASH_REMOVE, NULL);
+	stats_shared->dealloc = 0;
+	LWLockRelease(stats_shared->lock);
+
+	PG_RETURN_VOID();
+}
+
+Datum
+hypocost_stat_info(PG_FUNCTION_ARGS)
+{
+	int64 dealloc;
+
+	check_stats_available();
+
+	LWLockAcquire(stats_shared->lock, LW_SHARED);
+	dealloc = stats_shared->dealloc;
+	LWLockRelease(stats_shared->lock);
+
+	PG_RETURN_INT64(dealloc);
+}
@@ -0,0 +1,1069 @@
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "access/amapi.h"
+#include "access/htup_details.h"
+#include "access/reloptions.h"
+#include "catalog/pg_statistic.h"
+#include "catalog/pg_tablespace.h"
+#include "catalog/pg_type.h"
+#include "commands/tablespace.h"
+#include "common/hashfn.h"
+#include "optimizer/cost.h"
+#include "parser/parsetree.h"
+#include "postmaster/bgworker.h"
+#include "utils/acl.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/memutils.h"
+#include "utils/selfuncs.h"
+#include "utils/syscache.h"
+
+#include "hypocost.h"
+
+PG_FUNCTION_INFO_V1(hypocost_scale_relation);
+PG_FUNCTION_INFO_V1(hypocost_set_allvisfrac);
+PG_FUNCTION_INFO_V1(hypocost_set_correlation);
+PG_FUNCTION_INFO_V1(hypocost_inject_node_rows);
+PG_FUNCTION_INFO_V1(hypocost_inject_relation_rows);
+PG_FUNCTION_INFO_V1(hypocost_set_page_costs);
+PG_FUNCTION_INFO_V1(hypocost_set_tablespace_page_costs);
+PG_FUNCTION_INFO_V1(hypocost_set_gather_workers);
+PG_FUNCTION_INFO_V1(hypocost_whatif_reset);
+
+/*
+ * What-if overrides of the statistics a recost sees. They are applied to
+ * the captured path tree at the start of every top-level recost and undone
+ * by hypocost_release(), so the first pass always sees the real catalog.
+ */
+
+/* Data growth for one relation, or every relation when relid is invalid */
+typedef struct ScaleEntry
+{
+	Oid relid;
+	double pages;
+	double tuples;
+	// Multiplies the number of distinct values; <= 0 leaves the statistics alone.
+	double ndistinct;
+} ScaleEntry;
+
+static List* scales = NIL;
+
+/* Physical layout of one relation (allvisfrac) or index (correlation) */
+typedef struct LayoutEntry
+{
+	Oid oid;
+	double value;
+} LayoutEntry;
+
+static List* allvisfracs = NIL;
+static List* correlations = NIL;
+
+/*
+ * Rows injected for a recosted node of the statement with the given text, or
+ * for a base or join relation given by its sorted oids
+ */
+typedef struct RowsEntry
+{
+	char* query;
+	int node_id;
+	List* relids;
+	double rows;
+} RowsEntry;
+
+static List* node_rows = NIL;
+static List* relation_rows = NIL;
+
+/* Page costs of the storage a relation, or every relation in a tablespace, lives on; < 0 keeps the setting */
+typedef struct PageCostEntry
+{
+	Oid relid;
+	Oid spcid;
+	double seq_page_cost;
+	double random_page_cost;
+} PageCostEntry;
+
+static List* page_costs = NIL;
+
+/* Workers a Gather or Gather Merge, by node id in the statement with the given text, is recosted with */
+typedef struct WorkersEntry
+{
+	char* query;
+	int node_id;
+	int workers;
+} WorkersEntry;
+
+static List* gather_workers = NIL;
+
+// Node ids are only meaningful for the statement being recosted.
+static const char* active_query = NULL;
+
+/* A planner field overwritten by the current recost */
+typedef struct UndoEntry
+{
+	double* dfield;
+	double dvalue;
+	BlockNumber* bfield;
+	BlockNumber bvalue;
+	int* ifield;
+	int ivalue;
+	void (**ffield) ();
+	void (*fvalue) ();
+} UndoEntry;
+
+static List* undo = NIL;
+// Worker counts are only for the costs; they go back before the plan is built.
+static List* undo_workers = NIL;
+static bool whatif_applied = false;
+static bool rows_injected = false;
+
+static get_relation_stats_hook_type prev_get_relation_stats_hook = NULL;
+
+static bool
+for_active_query(const char* query)
+{
+	return query != NULL && active_query != NULL && strcmp(query, active_query) == 0;
+}
+
+static ScaleEntry*
+find_scale(Oid relid)
+{
+	ListCell* lc;
+	ScaleEntry* global = NULL;
+
+	foreach(lc, scales)
+	{
+		ScaleEntry* entry = (ScaleEntry*)lfirst(lc);
+		if (entry->relid == relid)
+			return entry;
+		if (!OidIsValid(entry->relid))
+			global = entry;
+	}
+	return global;
+}
+
+static LayoutEntry*
+find_layout(List* entries, Oid oid)
+{
+	ListCell* lc;
+
+	foreach(lc, entries)
+	{
+		LayoutEntry* entry = (LayoutEntry*)lfirst(lc);
+		if (entry->oid == oid)
+			return entry;
+	}
+	return NULL;
+}
+
+void
+hypocost_whatif_save(double* field)
+{
+	MemoryContext oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	UndoEntry* entry = palloc0(sizeof(UndoEntry));
+	entry->dfield = field;
+	entry->dvalue = *field;
+	undo = lappend(undo, entry);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+static void
+save_block(BlockNumber* field)
+{
+	MemoryContext oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	UndoEntry* entry = palloc0(sizeof(UndoEntry));
+	entry->bfield = field;
+	entry->bvalue = *field;
+	undo = lappend(undo, entry);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+// The oids of the relations making up rel in the order relation_rows keeps them, or NIL.
+static List*
+rel_oids(PlannerInfo* root, RelOptInfo* rel)
+{
+	List* oids = NIL;
+	int rti = -1;
+
+	while ((rti = bms_next_member(rel->relids, rti)) >= 0)
+	{
+		RangeTblEntry* rte = planner_rt_fetch(rti, root);
+		if (rte->rtekind != RTE_RELATION)
+		{
+			list_free(oids);
+			return NIL;
+		}
+		oids = lappend_oid(oids, rte->relid);
+	}
+	list_sort(oids, list_oid_cmp);
+	return oids;
+}
+
+static void
+save_function(void (**field) ())
+{
+	MemoryContext oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	UndoEntry* entry = palloc0(sizeof(UndoEntry));
+	entry->ffield = field;
+	entry->fvalue = *field;
+	undo = lappend(undo, entry);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+// The entry for relid, else the one for the tablespace it lives in.
+static PageCostEntry*
+find_page_costs(Oid relid, Oid spcid)
+{
+	PageCostEntry* found = NULL;
+	ListCell* lc;
+
+	if (!OidIsValid(spcid))
+		spcid = MyDatabaseTableSpace;
+	foreach(lc, page_costs)
+	{
+		PageCostEntry* entry = (PageCostEntry*)lfirst(lc);
+		if (entry->relid == relid)
+			return entry;
+		if (!OidIsValid(entry->relid) && entry->spcid == spcid)
+			found = entry;
+	}
+	return found;
+}
+
+// The planner prices pages by a tablespace's own options over the global settings we swap.
+static void
+check_tablespace_options(Oid spcid, PageCostEntry* entry)
+{
+	HeapTuple tp;
+	Datum datum;
+	bool isnull;
+	TableSpaceOpts* opts;
+	bool conflict = false;
+
+	if (!OidIsValid(spcid))
+		spcid = MyDatabaseTableSpace;
+	tp = SearchSysCache1(TABLESPACEOID, ObjectIdGetDatum(spcid));
+	if (!HeapTupleIsValid(tp))
+		return;
+
+	datum = SysCacheGetAttr(TABLESPACEOID, tp, Anum_pg_tablespace_spcoptions, &isnull);
+	if (!isnull)
+	{
+		opts = (TableSpaceOpts*) tablespace_reloptions(datum, false);
+		conflict = (entry->seq_page_cost >= 0 && opts->seq_page_cost >= 0) ||
+			(entry->random_page_cost >= 0 && opts->random_page_cost >= 0);
+	}
+	ReleaseSysCache(tp);
+
+	if (conflict)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("tablespace \"%s\" sets its own page costs, which would take precedence over hypocost's",
+						get_tablespace_name(spcid)),
+				 errhint("Reset the tablespace's seq_page_cost and random_page_cost options, or leave those costs NULL.")));
+}
+
+/*
+ * Runs the access method's own estimate with the page costs of the storage the
+ * index lives on, which may differ from its relation's, and replaces the
+ * correlation it read from the statistics.
+ */
+static void
+whatif_amcostestimate(PlannerInfo* root, IndexPath* path, double loop_count,
+					  Cost* indexStartupCost, Cost* indexTotalCost,
+					  Selectivity* indexSelectivity, double* indexCorrelation,
+					  double* indexPages)
+{
+	IndexOptInfo* index = path->indexinfo;
+	IndexAmRoutine* amroutine = GetIndexAmRoutineByAmId(index->relam, false);
+	LayoutEntry* layout = find_layout(correlations, index->indexoid);
+	double heap_seq_page_cost = seq_page_cost;
+	double heap_random_page_cost = random_page_cost;
+
+	// An error leaves the page costs to the restore of the wired state.
+	if (page_costs != NIL)
+	{
+		PageCostEntry* costs = find_page_costs(index->indexoid, index->reltablespace);
+		seq_page_cost = hypocost_seq_page_cost;
+		random_page_cost = hypocost_random_page_cost;
+		if (costs != NULL)
+		{
+			check_tablespace_options(index->reltablespace, costs);
+			if (costs->seq_page_cost >= 0)
+				seq_page_cost = costs->seq_page_cost;
+			if (costs->random_page_cost >= 0)
+				random_page_cost = costs->random_page_cost;
+		}
+	}
+
+	amroutine->amcostestimate(root, path, loop_count, indexStartupCost, indexTotalCost,
+							  indexSelectivity, indexCorrelation, indexPages);
+	pfree(amroutine);
+	seq_page_cost = heap_seq_page_cost;
+	random_page_cost = heap_random_page_cost;
+	if (layout == NULL)
+		return;
+
+	// cost_index() interpolates between the uncorrelated and the perfectly
+	// correlated heap fetch cost by the square of the correlation.
+	*indexCorrelation = layout->value;
+}
+
+void
+hypocost_whatif_save_workers(int* field)
+{
+	MemoryContext oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	UndoEntry* entry = palloc0(sizeof(UndoEntry));
+	entry->ifield = field;
+	entry->ivalue = *field;
+	undo_workers = lappend(undo_workers, entry);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+void
+hypocost_whatif_restore_workers(void)
+{
+	int i;
+
+	for (i = list_length(undo_workers) - 1; i >= 0; i--)
+	{
+		UndoEntry* entry = (UndoEntry*)list_nth(undo_workers, i);
+		*entry->ifield = entry->ivalue;
+	}
+
+	list_free_deep(undo_workers);
+	undo_workers = NIL;
+}
+
+// Forget the selectivities and bucket sizes the clauses cached from the unscaled statistics.
+void
+hypocost_whatif_reset_selectivity(List* rinfos)
+{
+	ListCell* lc;
+
+	foreach(lc, rinfos)
+	{
+		RestrictInfo* rinfo = (RestrictInfo*)lfirst(lc);
+		if (!IsA(rinfo, RestrictInfo))
+			continue;
+
+		hypocost_whatif_save(&rinfo->norm_selec);
+		hypocost_whatif_save(&rinfo->outer_selec);
+		hypocost_whatif_save(&rinfo->left_bucketsize);
+		hypocost_whatif_save(&rinfo->right_bucketsize);
+		hypocost_whatif_save(&rinfo->left_mcvfreq);
+		hypocost_whatif_save(&rinfo->right_mcvfreq);
+		rinfo->norm_selec = -1;
+		rinfo->outer_selec = -1;
+		rinfo->left_bucketsize = -1;
+		rinfo->right_bucketsize = -1;
+		rinfo->left_mcvfreq = -1;
+		rinfo->right_mcvfreq = -1;
+	}
+}
+
+static BlockNumber
+scale_pages(BlockNumber pages, double factor)
+{
+	return (BlockNumber) clamp_row_est(Min(pages * factor, (double) MaxBlockNumber));
+}
+
+static Oid
+rel_oid(PlannerInfo* root, RelOptInfo* rel)
+{
+	RangeTblEntry* rte;
+	if (rel->relid == 0 || (rel->reloptkind != RELOPT_BASEREL && rel->reloptkind != RELOPT_OTHER_MEMBER_REL))
+		return InvalidOid;
+
+	// Inheritance parents get their size from their children.
+	rte = planner_rt_fetch(rel->relid, root);
+	return rte->rtekind == RTE_RELATION && !rte->inh ? rte->relid : InvalidOid;
+}
+
+// Overrides the layout of the indexes; save is false for relations rebuilt during the recost.
+static void
+apply_indexes(RelOptInfo* rel, ScaleEntry* scale, bool save)
+{
+	ListCell* lc;
+
+	foreach(lc, rel->indexlist)
+	{
+		IndexOptInfo* index = (IndexOptInfo*)lfirst(lc);
+		if (scale != NULL)
+		{
+			if (save)
+			{
+				save_block(&index->pages);
+				hypocost_whatif_save(&index->tuples);
+			}
+			index->pages = scale_pages(index->pages, scale->pages);
+			index->tuples = clamp_row_est(index->tuples * scale->tuples);
+		}
+
+		if (find_layout(correlations, index->indexoid) != NULL &&
+			index->amcostestimate != (void (*) ()) whatif_amcostestimate)
+		{
+			if (save)
+				save_function(&index->amcostestimate);
+			index->amcostestimate = (void (*) ()) whatif_amcostestimate;
+		}
+	}
+}
+
+static void
+apply_allvisfrac(RelOptInfo* rel, Oid relid, bool save)
+{
+	LayoutEntry* layout = find_layout(allvisfracs, relid);
+	if (layout == NULL)
+		return;
+
+	if (save)
+		hypocost_whatif_save(&rel->allvisfrac);
+	rel->allvisfrac = layout->value;
+}
+
+static void
+apply_rel(PlannerInfo* root, RelOptInfo* rel)
+{
+	Oid relid = rel_oid(root, rel);
+	ScaleEntry* scale;
+	ListCell* lc;
+
+	if (!OidIsValid(relid))
+		return;
+
+	apply_allvisfrac(rel, relid, true);
+	scale = find_scale(relid);
+	apply_indexes(rel, scale, true);
+	if (scale == NULL)
+		return;
+
+	// Also turns on the ndistinct override for the estimates below.
+	whatif_applied = true;
+	save_block(&rel->pages);
+	hypocost_whatif_save(&rel->tuples);
+	hypocost_whatif_save(&rel->rows);
+	rel->pages = scale_pages(rel->pages, scale->pages);
+	rel->tuples = clamp_row_est(rel->tuples * scale->tuples);
+	hypocost_whatif_reset_selectivity(rel->baserestrictinfo);
+	set_baserel_size_estimates(root, rel);
+
+	// Parameterized scans take their rows from here rather than the relation.
+	foreach(lc, rel->ppilist)
+	{
+		ParamPathInfo* ppi = (ParamPathInfo*)lfirst(lc);
+		hypocost_whatif_reset_selectivity(ppi->ppi_clauses);
+		hypocost_whatif_save(&ppi->ppi_rows);
+		ppi->ppi_rows = get_parameterized_baserel_size(root, rel, ppi->ppi_clauses);
+	}
+}
+
+static void
+apply_root(PlannerInfo* root, List** visited)
+{
+	int i;
+
+	if (list_member_ptr(*visited, root))
+		return;
+	*visited = lappend(*visited, root);
+
+	for (i = 1; i < root->simple_rel_array_size; i++)
+	{
+		RelOptInfo* rel = root->simple_rel_array[i];
+		if (rel == NULL)
+			continue;
+
+		apply_rel(root, rel);
+		hypocost_whatif_inject_rows(root, rel);
+		if (rel->subroot != NULL)
+			apply_root(rel->subroot, visited);
+	}
+}
+
+void
+hypocost_whatif_restore(void)
+{
+	int i;
+
+	hypocost_whatif_restore_workers();
+
+	// Undo in reverse so a field saved twice ends up with its oldest value.
+	for (i = list_length(undo) - 1; i >= 0; i--)
+	{
+		UndoEntry* entry = (UndoEntry*)list_nth(undo, i);
+		if (entry->dfield != NULL)
+			*entry->dfield = entry->dvalue;
+		else if (entry->bfield != NULL)
+			*entry->bfield = entry->bvalue;
+		else if (entry->ifield != NULL)
+			*entry->ifield = entry->ivalue;
+		else
+			*entry->ffield = entry->fvalue;
+	}
+
+	list_free_deep(undo);
+	undo = NIL;
+	whatif_applied = false;
+	rows_injected = false;
+	active_query = NULL;
+}
+
+void
+hypocost_whatif_apply(PlannerInfo* root, const char* query_string)
+{
+	List* visited = NIL;
+	ListCell* lc;
+
+	hypocost_whatif_restore();
+	active_query = query_string;
+	if (scales == NIL && allvisfracs == NIL && correlations == NIL && relation_rows == NIL)
+		return;
+
+	apply_root(root, &visited);
+	foreach(lc, root->glob->subroots)
+		apply_root((PlannerInfo*)lfirst(lc), &visited);
+	list_free(visited);
+}
+
+bool
+hypocost_whatif_rows_changed(void)
+{
+	return whatif_applied || rows_injected;
+}
+
+// Override a relation rebuilt for substitution, which copies the already scaled sizes but reads
+// its layout and indexes from the catalog again.
+void
+hypocost_whatif_apply_rebuilt(PlannerInfo* root, RelOptInfo* rel)
+{
+	Oid relid = rel_oid(root, rel);
+	if (!OidIsValid(relid))
+		return;
+
+	apply_allvisfrac(rel, relid, false);
+	apply_indexes(rel, whatif_applied ? find_scale(relid) : NULL, false);
+}
+
+// Override the rows of a base or join relation whose estimate was just (re)computed.
+void
+hypocost_whatif_inject_rows(PlannerInfo* root, RelOptInfo* rel)
+{
+	List* oids;
+	ListCell* lc;
+
+	if (relation_rows == NIL || (oids = rel_oids(root, rel)) == NIL)
+		return;
+
+	foreach(lc, relation_rows)
+	{
+		RowsEntry* entry = (RowsEntry*)lfirst(lc);
+		if (equal(entry->relids, oids))
+		{
+			hypocost_whatif_save(&rel->rows);
+			rel->rows = entry->rows;
+			break;
+		}
+	}
+	list_free(oids);
+}
+
+bool
+hypocost_whatif_has_node_rows(const char* query_string)
+{
+	ListCell* lc;
+
+	foreach(lc, node_rows)
+	{
+		RowsEntry* entry = (RowsEntry*)lfirst(lc);
+		if (query_string != NULL && strcmp(entry->query, query_string) == 0)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Override the rows of a node once it has been recosted, for its parent to
+ * see. Joins size themselves from their input relations, so an unparameterized,
+ * non-partial node hands the rows to its relation as well.
+ */
+void
+hypocost_whatif_node_rows(int node_id, Path* path)
+{
+	ListCell* lc;
+
+	foreach(lc, node_rows)
+	{
+		RowsEntry* entry = (RowsEntry*)lfirst(lc);
+		if (entry->node_id == node_id && for_active_query(entry->query))
+		{
+			path->rows = entry->rows;
+			if (path->param_info == NULL && !path->parallel_aware && path->parallel_workers == 0 &&
+			    (IS_SIMPLE_REL(path->parent) || IS_JOIN_REL(path->parent)))
+			{
+				hypocost_whatif_save(&path->parent->rows);
+				path->parent->rows = entry->rows;
+				rows_injected = true;
+			}
+			return;
+		}
+	}
+}
+
+/*
+ * Override *seq and *random with the page costs of the storage rel lives on,
+ * giving a relation's own entry precedence over its tablespace's. Returns
+ * false if neither has one. The pages of its indexes are priced by their own
+ * entries when the access method estimates them.
+ */
+bool
+hypocost_whatif_page_costs(PlannerInfo* root, RelOptInfo* rel, double* seq, double* random)
+{
+	Oid relid;
+	PageCostEntry* found;
+	ListCell* lc;
+
+	if (page_costs == NIL)
+		return false;
+
+	foreach(lc, rel->indexlist)
+	{
+		IndexOptInfo* index = (IndexOptInfo*)lfirst(lc);
+		if (index->amcostestimate != (void (*) ()) whatif_amcostestimate)
+		{
+			save_function(&index->amcostestimate);
+			index->amcostestimate = (void (*) ()) whatif_amcostestimate;
+		}
+	}
+
+	if (!OidIsValid(relid = rel_oid(root, rel)))
+		return false;
+	found = find_page_costs(relid, rel->reltablespace);
+	if (found == NULL)
+		return false;
+	check_tablespace_options(rel->reltablespace, found);
+	if (found->seq_page_cost >= 0)
+		*seq = found->seq_page_cost;
+	if (found->random_page_cost >= 0)
+		*random = found->random_page_cost;
+	return true;
+}
+
+// Workers to recost the Gather with node_id with: its own override, else hypocost.parallel_workers.
+bool
+hypocost_whatif_gather_workers(int node_id, int* workers)
+{
+	ListCell* lc;
+
+	foreach(lc, gather_workers)
+	{
+		WorkersEntry* entry = (WorkersEntry*)lfirst(lc);
+		if (entry->node_id == node_id && for_active_query(entry->query))
+		{
+			*workers = entry->workers;
+			return true;
+		}
+	}
+
+	if (hypocost_parallel_workers < 0)
+		return false;
+	*workers = hypocost_parallel_workers;
+	return true;
+}
+
+bool
+hypocost_whatif_active(void)
+{
+	return scales != NIL || allvisfracs != NIL || correlations != NIL || node_rows != NIL ||
+		relation_rows != NIL || page_costs != NIL || gather_workers != NIL;
+}
+
+uint64
+hypocost_whatif_hash(void)
+{
+	ListCell* lc;
+	uint64 hash = 0;
+
+	foreach(lc, scales)
+	{
+		ScaleEntry* entry = (ScaleEntry*)lfirst(lc);
+		hash = hash_combine64(hash, hash_bytes_extended((const unsigned char*)entry, sizeof(ScaleEntry), 0));
+	}
+	foreach(lc, allvisfracs)
+		hash = hash_combine64(hash, hash_bytes_extended((const unsigned char*)lfirst(lc), sizeof(LayoutEntry), 0));
+	// Keep an index and a relation with the same override apart.
+	hash = hash_combine64(hash, list_length(allvisfracs));
+	foreach(lc, correlations)
+		hash = hash_combine64(hash, hash_bytes_extended((const unsigned char*)lfirst(lc), sizeof(LayoutEntry), 0));
+	foreach(lc, node_rows)
+	{
+		RowsEntry* entry = (RowsEntry*)lfirst(lc);
+		hash = hash_combine64(hash, hash_bytes_extended((const unsigned char*)entry->query, strlen(entry->query), 0));
+		hash = hash_combine64(hash, hash_uint32_extended(entry->node_id, 0));
+		hash = hash_combine64(hash, hash_bytes_extended((const unsigned char*)&entry->rows, sizeof(double), 0));
+	}
+	foreach(lc, relation_rows)
+	{
+		RowsEntry* entry = (RowsEntry*)lfirst(lc);
+		ListCell* oc;
+		foreach(oc, entry->relids)
+			hash = hash_combine64(hash, hash_uint32_extended(lfirst_oid(oc), 0));
+		hash = hash_combine64(hash, hash_bytes_extended((const unsigned char*)&entry->rows, sizeof(double), 0));
+	}
+	foreach(lc, page_costs)
+		hash = hash_combine64(hash, hash_bytes_extended((const unsigned char*)lfirst(lc), sizeof(PageCostEntry), 0));
+	foreach(lc, gather_workers)
+	{
+		WorkersEntry* entry = (WorkersEntry*)lfirst(lc);
+		hash = hash_combine64(hash, hash_bytes_extended((const unsigned char*)entry->query, strlen(entry->query), 0));
+		hash = hash_combine64(hash, hash_uint32_extended(entry->node_id, 0));
+		hash = hash_combine64(hash, hash_uint32_extended(entry->workers, 0));
+	}
+	return hash;
+}
+
+static bool
+whatif_relation_stats(PlannerInfo* root, RangeTblEntry* rte, AttrNumber attnum, VariableStatData* vardata)
+{
+	ScaleEntry* scale;
+	HeapTuple tuple;
+	Form_pg_statistic stats;
+	Oid userid;
+
+	if (!whatif_applied || attnum <= 0 || rte->rtekind != RTE_RELATION ||
+	    (scale = find_scale(rte->relid)) == NULL || scale->ndistinct <= 0)
+	{
+		if (prev_get_relation_stats_hook)
+			return prev_get_relation_stats_hook(root, rte, attnum, vardata);
+		return false;
+	}
+
+	tuple = SearchSysCache3(STATRELATTINH,
+							ObjectIdGetDatum(rte->relid),
+							Int16GetDatum(attnum),
+							BoolGetDatum(rte->inh));
+	if (!HeapTupleIsValid(tuple))
+		return false;
+
+	vardata->statsTuple = heap_copytuple(tuple);
+	vardata->freefunc = heap_freetuple;
+	ReleaseSysCache(tuple);
+
+	// A negative stadistinct is a fraction of the (already scaled) row count.
+	stats = (Form_pg_statistic) GETSTRUCT(vardata->statsTuple);
+	if (stats->stadistinct > 0)
+		stats->stadistinct *= scale->ndistinct;
+	else if (stats->stadistinct < 0)
+		stats->stadistinct = Max(stats->stadistinct * scale->ndistinct / Max(scale->tuples, 1e-10), -1.0);
+
+	// Same check examine_simple_variable() makes for statistics it finds itself.
+	userid = OidIsValid(rte->checkAsUser) ? rte->checkAsUser : GetUserId();
+	vardata->acl_ok = rte->securityQuals == NIL &&
+		(pg_class_aclcheck(rte->relid, userid, ACL_SELECT) == ACLCHECK_OK ||
+		 pg_attribute_aclcheck(rte->relid, attnum, userid, ACL_SELECT) == ACLCHECK_OK);
+	return true;
+}
+
+void
+hypocost_whatif_init(void)
+{
+	prev_get_relation_stats_hook = get_relation_stats_hook;
+	get_relation_stats_hook = whatif_relation_stats;
+}
+
+Datum
+hypocost_scale_relation(PG_FUNCTION_ARGS)
+{
+	Oid relid = PG_ARGISNULL(0) ? InvalidOid : PG_GETARG_OID(0);
+	double pages = PG_ARGISNULL(1) ? 1.0 : PG_GETARG_FLOAT8(1);
+	double tuples = PG_ARGISNULL(2) ? 1.0 : PG_GETARG_FLOAT8(2);
+	double ndistinct = PG_ARGISNULL(3) ? 0.0 : PG_GETARG_FLOAT8(3);
+	ScaleEntry* entry = NULL;
+	ListCell* lc;
+	MemoryContext oldcontext;
+
+	if (pages <= 0 || tuples <= 0 || (!PG_ARGISNULL(3) && ndistinct <= 0))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("scale factors must be positive")));
+
+	foreach(lc, scales)
+	{
+		if (((ScaleEntry*)lfirst(lc))->relid == relid)
+			entry = (ScaleEntry*)lfirst(lc);
+	}
+
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	if (entry == NULL)
+	{
+		// Zero the padding since the entries are hashed as blobs.
+		entry = palloc0(sizeof(ScaleEntry));
+		entry->relid = relid;
+		scales = lappend(scales, entry);
+	}
+	entry->pages = pages;
+	entry->tuples = tuples;
+	entry->ndistinct = ndistinct;
+	MemoryContextSwitchTo(oldcontext);
+	PG_RETURN_VOID();
+}
+
+static void
+set_layout(List** entries, Oid oid, double value)
+{
+	LayoutEntry* entry = find_layout(*entries, oid);
+	MemoryContext oldcontext;
+
+	if (entry == NULL)
+	{
+		oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+		entry = palloc0(sizeof(LayoutEntry));
+		entry->oid = oid;
+		*entries = lappend(*entries, entry);
+		MemoryContextSwitchTo(oldcontext);
+	}
+	entry->value = value;
+}
+
+Datum
+hypocost_set_allvisfrac(PG_FUNCTION_ARGS)
+{
+	double allvisfrac = PG_GETARG_FLOAT8(1);
+
+	if (allvisfrac < 0 || allvisfrac > 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("all-visible fraction must be between 0 and 1")));
+
+	set_layout(&allvisfracs, PG_GETARG_OID(0), allvisfrac);
+	PG_RETURN_VOID();
+}
+
+Datum
+hypocost_set_correlation(PG_FUNCTION_ARGS)
+{
+	double correlation = PG_GETARG_FLOAT8(1);
+
+	if (correlation < -1 || correlation > 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("correlation must be between -1 and 1")));
+
+	set_layout(&correlations, PG_GETARG_OID(0), correlation);
+	PG_RETURN_VOID();
+}
+
+static void
+set_rows(List** entries, const char* query, int node_id, List* relids, double rows)
+{
+	RowsEntry* entry = NULL;
+	ListCell* lc;
+	MemoryContext oldcontext;
+
+	if (rows < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("rows must not be negative")));
+
+	foreach(lc, *entries)
+	{
+		RowsEntry* cur = (RowsEntry*)lfirst(lc);
+		if (cur->node_id == node_id && equal(cur->relids, relids) &&
+		    (query == NULL ? cur->query == NULL : cur->query != NULL && strcmp(cur->query, query) == 0))
+			entry = cur;
+	}
+
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	if (entry == NULL)
+	{
+		entry = palloc0(sizeof(RowsEntry));
+		entry->query = query != NULL ? pstrdup(query) : NULL;
+		entry->node_id = node_id;
+		entry->relids = list_copy(relids);
+		*entries = lappend(*entries, entry);
+	}
+	entry->rows = clamp_row_est(rows);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+static void
+free_rows(List* entries)
+{
+	ListCell* lc;
+
+	foreach(lc, entries)
+	{
+		RowsEntry* entry = (RowsEntry*)lfirst(lc);
+		list_free(entry->relids);
+		if (entry->query != NULL)
+			pfree(entry->query);
+	}
+	list_free_deep(entries);
+}
+
+Datum
+hypocost_inject_node_rows(PG_FUNCTION_ARGS)
+{
+	char* query = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	int node_id = PG_GETARG_INT32(1);
+
+	if (node_id < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("node id must not be negative")));
+
+	set_rows(&node_rows, query, node_id, NIL, PG_GETARG_FLOAT8(2));
+	PG_RETURN_VOID();
+}
+
+Datum
+hypocost_inject_relation_rows(PG_FUNCTION_ARGS)
+{
+	ArrayType* arr = PG_GETARG_ARRAYTYPE_P(0);
+	Datum* elems;
+	bool* nulls;
+	int nelems;
+	int i;
+	List* relids = NIL;
+
+	deconstruct_array(arr, REGCLASSOID, sizeof(Oid), true, TYPALIGN_INT, &elems, &nulls, &nelems);
+	for (i = 0; i < nelems; i++)
+	{
+		if (nulls[i])
+			ereport(ERROR,
+					(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+					 errmsg("relations must not contain nulls")));
+		relids = lappend_oid(relids, DatumGetObjectId(elems[i]));
+	}
+	if (relids == NIL)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("relations must not be empty")));
+
+	list_sort(relids, list_oid_cmp);
+	set_rows(&relation_rows, NULL, -1, relids, PG_GETARG_FLOAT8(1));
+	list_free(relids);
+	PG_RETURN_VOID();
+}
+
+static void
+set_page_costs(Oid relid, Oid spcid, FunctionCallInfo fcinfo)
+{
+	double seq = PG_ARGISNULL(1) ? -1 : PG_GETARG_FLOAT8(1);
+	double random = PG_ARGISNULL(2) ? -1 : PG_GETARG_FLOAT8(2);
+	PageCostEntry* entry = NULL;
+	ListCell* lc;
+	MemoryContext oldcontext;
+
+	if ((!PG_ARGISNULL(1) && seq < 0) || (!PG_ARGISNULL(2) && random < 0))
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("page costs must not be negative")));
+
+	foreach(lc, page_costs)
+	{
+		PageCostEntry* cur = (PageCostEntry*)lfirst(lc);
+		if (cur->relid == relid && cur->spcid == spcid)
+			entry = cur;
+	}
+
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	if (entry == NULL)
+	{
+		// Zero the padding since the entries are hashed as blobs.
+		entry = palloc0(sizeof(PageCostEntry));
+		entry->relid = relid;
+		entry->spcid = spcid;
+		page_costs = lappend(page_costs, entry);
+	}
+	entry->seq_page_cost = seq;
+	entry->random_page_cost = random;
+	MemoryContextSwitchTo(oldcontext);
+}
+
+Datum
+hypocost_set_page_costs(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("relation must not be null")));
+
+	set_page_costs(PG_GETARG_OID(0), InvalidOid, fcinfo);
+	PG_RETURN_VOID();
+}
+
+Datum
+hypocost_set_tablespace_page_costs(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("tablespace must not be null")));
+
+	set_page_costs(InvalidOid, get_tablespace_oid(NameStr(*PG_GETARG_NAME(0)), false), fcinfo);
+	PG_RETURN_VOID();
+}
+
+Datum
+hypocost_set_gather_workers(PG_FUNCTION_ARGS)
+{
+	char* query = text_to_cstring(PG_GETARG_TEXT_PP(0));
+	int node_id = PG_GETARG_INT32(1);
+	int workers = PG_GETARG_INT32(2);
+	WorkersEntry* entry = NULL;
+	ListCell* lc;
+	MemoryContext oldcontext;
+
+	if (node_id < 0)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("node id must not be negative")));
+	// A Gather without workers would have the leader run the partial plan alone, which the divisor doesn't model.
+	if (workers < 1 || workers > MAX_PARALLEL_WORKER_LIMIT)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("workers must be between 1 and %d", MAX_PARALLEL_WORKER_LIMIT)));
+
+	foreach(lc, gather_workers)
+	{
+		WorkersEntry* cur = (WorkersEntry*)lfirst(lc);
+		if (cur->node_id == node_id && strcmp(cur->query, query) == 0)
+			entry = cur;
+	}
+
+	oldcontext = MemoryContextSwitchTo(TopMemoryContext);
+	if (entry == NULL)
+	{
+		entry = palloc0(sizeof(WorkersEntry));
+		entry->query = pstrdup(query);
+		entry->node_id = node_id;
+		gather_workers = lappend(gather_workers, entry);
+	}
+	entry->workers = workers;
+	MemoryContextSwitchTo(oldcontext);
+	PG_RETURN_VOID();
+}
+
+Datum
+hypocost_whatif_reset(PG_FUNCTION_ARGS)
+{
+	ListCell* lc;
+
+	list_free_deep(scales);
+	scales = NIL;
+	list_free_deep(allvisfracs);
+	allvisfracs = NIL;
+	list_free_deep(correlations);
+	correlations = NIL;
+	free_rows(node_rows);
+	node_rows = NIL;
+	free_rows(relation_rows);
+	relation_rows = NIL;
+	list_free_deep(page_costs);
+	page_costs = NIL;
+	foreach(lc, gather_workers)
+		pfree(((WorkersEntry*)lfirst(lc))->query);
+	list_free_deep(gather_workers);
+	gather_workers = NIL;
+	PG_RETURN_VOID();
+}
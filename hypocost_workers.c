@@ -0,0 +1,368 @@
+#include "postgres.h"
+#include "fmgr.h"
+#include "miscadmin.h"
+#include "access/transam.h"
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "storage/ipc.h"
+#include "storage/lmgr.h"
+#include "tcop/tcopprot.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+
+#include "hypocost.h"
+
+PG_FUNCTION_INFO_V1(hypocost_workload_submit);
+
+PGDLLEXPORT void hypocost_worker_main(Datum main_arg);
+
+// Workload rows handled per transaction; results become visible batch by batch.
+#define WORKLOAD_BATCH_SIZE 100
+
+/* Handed to every worker through bgw_extra */
+typedef struct WorkerArgs
+{
+	Oid dbid;
+	Oid userid;
+	Oid workload;
+	Oid configs;
+	Oid output;
+	int worker;
+	int nworkers;
+	// The submitting transaction; the workers only run once it has committed.
+	TransactionId xid;
+} WorkerArgs;
+
+typedef struct WorkloadConfig
+{
+	int32 id;
+	double seq_page_cost;
+	double random_page_cost;
+} WorkloadConfig;
+
+static char*
+qualified_name(Oid relid)
+{
+	char* relname = get_rel_name(relid);
+	if (relname == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_UNDEFINED_TABLE),
+				 errmsg("relation with OID %u does not exist", relid)));
+	return quote_qualified_identifier(get_namespace_name(get_rel_namespace(relid)), relname);
+}
+
+static char*
+workload_query(Oid workload)
+{
+	return psprintf("SELECT id::int8, query::text, weight::float8, config_id::int4 FROM %s "
+					"WHERE ((id %% $1) + $1) %% $1 = $2 AND id > $3 ORDER BY id LIMIT %d",
+					qualified_name(workload), WORKLOAD_BATCH_SIZE);
+}
+
+static char*
+configs_query(Oid configs)
+{
+	return psprintf("SELECT id::int4, seq_page_cost::float8, random_page_cost::float8 FROM %s", qualified_name(configs));
+}
+
+static char*
+output_query(Oid output)
+{
+	return psprintf("INSERT INTO %s (workload_id, config_id, weight, startup_cost, total_cost, plan_rows, error) "
+					"VALUES ($1, $2, $3, $4, $5, $6, $7)",
+					qualified_name(output));
+}
+
+static WorkloadConfig*
+load_configs(Oid configs, int* nconfigs)
+{
+	WorkloadConfig* result;
+	uint64 i;
+	bool isnull;
+
+	if (SPI_execute(configs_query(configs), true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "hypocost could not read the workload configurations");
+
+	*nconfigs = (int)SPI_processed;
+	result = MemoryContextAlloc(TopMemoryContext, sizeof(WorkloadConfig) * Max(SPI_processed, 1));
+	for (i = 0; i < SPI_processed; i++)
+	{
+		HeapTuple tuple = SPI_tuptable->vals[i];
+		TupleDesc desc = SPI_tuptable->tupdesc;
+		result[i].id = DatumGetInt32(SPI_getbinval(tuple, desc, 1, &isnull));
+		result[i].seq_page_cost = DatumGetFloat8(SPI_getbinval(tuple, desc, 2, &isnull));
+		result[i].random_page_cost = DatumGetFloat8(SPI_getbinval(tuple, desc, 3, &isnull));
+	}
+	return result;
+}
+
+static WorkloadConfig*
+find_config(WorkloadConfig* configs, int nconfigs, int32 id)
+{
+	int i;
+	for (i = 0; i < nconfigs; i++)
+	{
+		if (configs[i].id == id)
+			return &configs[i];
+	}
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("workload configuration %d does not exist", id)));
+	return NULL;
+}
+
+/*
+ * Recost one workload query through the planner hook in a subtransaction,
+ * so a query that fails only records its error.
+ */
+static void
+recost_one(const char* output_sql, int64 id, const char* query_string, Datum weight, bool weight_null,
+		   WorkloadConfig* configs, int nconfigs, int32 config_id, bool config_null)
+{
+	MemoryContext oldcontext = CurrentMemoryContext;
+	ResourceOwner oldowner = CurrentResourceOwner;
+	Oid argtypes[7] = { INT8OID, INT4OID, FLOAT8OID, FLOAT8OID, FLOAT8OID, FLOAT8OID, TEXTOID };
+	Datum values[7];
+	char nulls[7] = { ' ', ' ', ' ', 'n', 'n', 'n', 'n' };
+	double old_seq_page_cost = hypocost_seq_page_cost;
+	double old_random_page_cost = hypocost_random_page_cost;
+
+	values[0] = Int64GetDatum(id);
+	values[1] = Int32GetDatum(config_id);
+	values[2] = weight;
+	if (config_null)
+		nulls[1] = 'n';
+	if (weight_null)
+		nulls[2] = 'n';
+
+	BeginInternalSubTransaction(NULL);
+	MemoryContextSwitchTo(oldcontext);
+	PG_TRY();
+	{
+		Query* query;
+		PlannedStmt* plan;
+
+		if (!config_null)
+		{
+			WorkloadConfig* config = find_config(configs, nconfigs, config_id);
+			hypocost_seq_page_cost = config->seq_page_cost;
+			hypocost_random_page_cost = config->random_page_cost;
+		}
+
+		query = hypocost_parse_query(query_string);
+		plan = hypocost_planner(query, query_string, CURSOR_OPT_PARALLEL_OK, NULL);
+		values[3] = Float8GetDatum(plan->planTree->startup_cost);
+		values[4] = Float8GetDatum(plan->planTree->total_cost);
+		values[5] = Float8GetDatum(plan->planTree->plan_rows);
+		nulls[3] = nulls[4] = nulls[5] = ' ';
+
+		hypocost_seq_page_cost = old_seq_page_cost;
+		hypocost_random_page_cost = old_random_page_cost;
+		ReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
+	}
+	PG_CATCH();
+	{
+		ErrorData* edata;
+
+		hypocost_seq_page_cost = old_seq_page_cost;
+		hypocost_random_page_cost = old_random_page_cost;
+		MemoryContextSwitchTo(oldcontext);
+		edata = CopyErrorData();
+		FlushErrorState();
+		RollbackAndReleaseCurrentSubTransaction();
+		MemoryContextSwitchTo(oldcontext);
+		CurrentResourceOwner = oldowner;
+
+		values[6] = CStringGetTextDatum(edata->message);
+		nulls[6] = ' ';
+		FreeErrorData(edata);
+	}
+	PG_END_TRY();
+
+	if (SPI_execute_with_args(output_sql, 7, argtypes, values, nulls, false, 0) != SPI_OK_INSERT)
+		elog(ERROR, "hypocost could not write a workload result");
+}
+
+void
+hypocost_worker_main(Datum main_arg)
+{
+	WorkerArgs args;
+	WorkloadConfig* configs = NULL;
+	int nconfigs = 0;
+	int64 last_id = PG_INT64_MIN;
+	MemoryContext row_cxt;
+	bool done = false;
+	bool committed;
+
+	memcpy(&args, MyBgworkerEntry->bgw_extra, sizeof(WorkerArgs));
+	BackgroundWorkerUnblockSignals();
+	BackgroundWorkerInitializeConnectionByOid(args.dbid, args.userid, 0);
+
+	// A worker can't be unregistered, so a rolled back submission ends here instead.
+	StartTransactionCommand();
+	XactLockTableWait(args.xid, NULL, NULL, XLTW_None);
+	committed = TransactionIdDidCommit(args.xid);
+	CommitTransactionCommand();
+	if (!committed)
+		proc_exit(0);
+
+	// Recost every query regardless of how the server is configured.
+	SetConfigOption("hypocost.enable", "on", PGC_SUSET, PGC_S_OVERRIDE);
+	SetConfigOption("hypocost.activation", "always", PGC_SUSET, PGC_S_OVERRIDE);
+
+	row_cxt = AllocSetContextCreate(TopMemoryContext, "hypocost workload row", ALLOCSET_DEFAULT_SIZES);
+
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	SPI_connect();
+	PushActiveSnapshot(GetTransactionSnapshot());
+	configs = load_configs(args.configs, &nconfigs);
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+
+	while (!done)
+	{
+		Oid argtypes[3] = { INT8OID, INT8OID, INT8OID };
+		Datum values[3];
+		SPITupleTable* batch;
+		char* output_sql;
+		uint64 nrows;
+		uint64 i;
+
+		CHECK_FOR_INTERRUPTS();
+		SetCurrentStatementStartTimestamp();
+		StartTransactionCommand();
+		SPI_connect();
+		PushActiveSnapshot(GetTransactionSnapshot());
+		pgstat_report_activity(STATE_RUNNING, "hypocost workload");
+
+		values[0] = Int64GetDatum(args.nworkers);
+		values[1] = Int64GetDatum(args.worker);
+		values[2] = Int64GetDatum(last_id);
+		if (SPI_execute_with_args(workload_query(args.workload), 3, argtypes, values, NULL, true, 0) != SPI_OK_SELECT)
+			elog(ERROR, "hypocost could not read the workload");
+
+		batch = SPI_tuptable;
+		nrows = SPI_processed;
+		output_sql = output_query(args.output);
+		done = nrows < WORKLOAD_BATCH_SIZE;
+		for (i = 0; i < nrows; i++)
+		{
+			HeapTuple tuple = batch->vals[i];
+			TupleDesc desc = batch->tupdesc;
+			bool id_null;
+			bool query_null;
+			bool weight_null;
+			bool config_null;
+			int64 id = DatumGetInt64(SPI_getbinval(tuple, desc, 1, &id_null));
+			Datum query = SPI_getbinval(tuple, desc, 2, &query_null);
+			Datum weight = SPI_getbinval(tuple, desc, 3, &weight_null);
+			int32 config_id = DatumGetInt32(SPI_getbinval(tuple, desc, 4, &config_null));
+			MemoryContext oldcontext;
+
+			last_id = id;
+			if (query_null)
+				continue;
+
+			CHECK_FOR_INTERRUPTS();
+			oldcontext = MemoryContextSwitchTo(row_cxt);
+			PG_TRY();
+			{
+				recost_one(output_sql, id, TextDatumGetCString(query), weight, weight_null, configs, nconfigs, config_id, config_null);
+			}
+			PG_FINALLY();
+			{
+				MemoryContextSwitchTo(oldcontext);
+				MemoryContextReset(row_cxt);
+			}
+			PG_END_TRY();
+		}
+
+		SPI_finish();
+		PopActiveSnapshot();
+		CommitTransactionCommand();
+		pgstat_report_activity(STATE_IDLE, NULL);
+	}
+
+	proc_exit(0);
+}
+
+Datum
+hypocost_workload_submit(PG_FUNCTION_ARGS)
+{
+	WorkerArgs args;
+	int nworkers = PG_GETARG_INT32(3);
+	BackgroundWorkerHandle** handles;
+	int i;
+
+	// The workers override superuser-only settings on the caller's behalf.
+	if (!superuser())
+		ereport(ERROR,
+				(errcode(ERRCODE_INSUFFICIENT_PRIVILEGE),
+				 errmsg("must be superuser to submit a hypocost workload")));
+
+	if (nworkers < 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("nworkers must be at least 1")));
+
+	memset(&args, 0x00, sizeof(WorkerArgs));
+	args.dbid = MyDatabaseId;
+	args.userid = GetUserId();
+	args.workload = PG_GETARG_OID(0);
+	args.configs = PG_GETARG_OID(1);
+	args.output = PG_GETARG_OID(2);
+	args.nworkers = nworkers;
+	args.xid = GetTopTransactionId();
+
+	// Catch a malformed table here rather than in a worker nobody is watching.
+	SPI_connect();
+	if (SPI_execute(psprintf("SELECT id::int8, query::text, weight::float8, config_id::int4 FROM %s LIMIT 0", qualified_name(args.workload)), true, 0) != SPI_OK_SELECT ||
+		SPI_execute(psprintf("%s LIMIT 0", configs_query(args.configs)), true, 0) != SPI_OK_SELECT ||
+		SPI_execute(psprintf("SELECT workload_id, config_id, weight, startup_cost, total_cost, plan_rows, error FROM %s LIMIT 0", qualified_name(args.output)), true, 0) != SPI_OK_SELECT)
+		elog(ERROR, "hypocost could not validate the workload tables");
+	SPI_finish();
+
+	handles = palloc0(sizeof(BackgroundWorkerHandle*) * nworkers);
+	for (i = 0; i < nworkers; i++)
+	{
+		BackgroundWorker worker;
+
+		memset(&worker, 0x00, sizeof(BackgroundWorker));
+		worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+		worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+		worker.bgw_restart_time = BGW_NEVER_RESTART;
+		snprintf(worker.bgw_library_name, BGW_MAXLEN, "hypocost");
+		snprintf(worker.bgw_function_name, BGW_MAXLEN, "hypocost_worker_main");
+		snprintf(worker.bgw_name, BGW_MAXLEN, "hypocost workload worker %d/%d", i + 1, nworkers);
+		snprintf(worker.bgw_type, BGW_MAXLEN, "hypocost workload worker");
+
+		args.worker = i;
+		StaticAssertStmt(sizeof(WorkerArgs) <= BGW_EXTRALEN, "WorkerArgs does not fit in bgw_extra");
+		memcpy(worker.bgw_extra, &args, sizeof(WorkerArgs));
+
+		if (!RegisterDynamicBackgroundWorker(&worker, &handles[i]))
+		{
+			int j;
+
+			// Every worker owns a slice of the workload; don't leave some of it unhandled.
+			for (j = 0; j < i; j++)
+				TerminateBackgroundWorker(handles[j]);
+			ereport(ERROR,
+					(errcode(ERRCODE_INSUFFICIENT_RESOURCES),
+					 errmsg("could only start %d of %d hypocost workers", i, nworkers),
+					 errhint("You may need to increase max_worker_processes.")));
+		}
+	}
+
+	PG_RETURN_INT32(nworkers);
+}
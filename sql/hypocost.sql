@@ -0,0 +1,295 @@
+CREATE EXTENSION hypocost;
+
+CREATE TABLE hc_t (id int PRIMARY KEY, v int);
+INSERT INTO hc_t SELECT i, i % 100 FROM generate_series(1, 10000) i;
+ANALYZE hc_t;
+
+-- The live settings recost to the original costs.
+SELECT count(*) > 0 AS has_nodes,
+       bool_and(abs(total_cost - original_total_cost) < 1e-6) AS unchanged
+  FROM hypocost_costs('SELECT * FROM hc_t WHERE id = 42');
+
+SELECT relation, index_name
+  FROM hypocost_costs('SELECT * FROM hc_t WHERE id = 42')
+ WHERE relation IS NOT NULL;
+
+-- Slower random reads only make the index scan dearer.
+SET hypocost.random_page_cost = 40;
+SELECT bool_or(total_cost > original_total_cost) AS dearer
+  FROM hypocost_costs('SELECT * FROM hc_t WHERE id = 42');
+RESET hypocost.random_page_cost;
+
+-- Prepared statements.
+SELECT hypocost_prepare('SELECT * FROM hc_t WHERE id = 42') AS handle \gset
+SELECT count(*) > 0 AS has_nodes FROM hypocost_prepared_costs(:handle);
+SELECT hypocost_deallocate(:handle);
+
+-- What-if statistics.
+SELECT hypocost_scale_relation('hc_t', pages => 10, tuples => 10);
+SELECT bool_or(rows > original_rows) AS grown
+  FROM hypocost_costs('SELECT * FROM hc_t');
+SELECT * FROM hypocost_regret('SELECT * FROM hc_t');
+SELECT hypocost_whatif_reset();
+
+-- Node ids only apply to the query text they were taken from.
+SELECT hypocost_inject_rows('SELECT * FROM hc_t WHERE v = 1', 0, 5);
+SELECT bool_and(rows = original_rows) AS untouched
+  FROM hypocost_costs('SELECT * FROM hc_t WHERE v = 2');
+SELECT hypocost_whatif_reset();
+
+-- Every planner setting is part of the cache key.
+CREATE TABLE hc_p (k int, v int) PARTITION BY LIST (k);
+CREATE TABLE hc_p_1 PARTITION OF hc_p FOR VALUES IN (1);
+CREATE TABLE hc_p_2 PARTITION OF hc_p FOR VALUES IN (2);
+INSERT INTO hc_p SELECT i % 2 + 1, i FROM generate_series(1, 1000) i;
+ANALYZE hc_p;
+SELECT string_agg(DISTINCT relation, ',') AS relations
+  FROM hypocost_costs('SELECT * FROM hc_p WHERE k = 1');
+SET enable_partition_pruning = off;
+SET constraint_exclusion = off;
+SELECT string_agg(DISTINCT relation, ',') AS relations
+  FROM hypocost_costs('SELECT * FROM hc_p WHERE k = 1');
+RESET enable_partition_pruning;
+RESET constraint_exclusion;
+
+-- A prepared statement is captured again once any planner setting changes.
+SELECT hypocost_prepare('SELECT * FROM hc_p WHERE k = 1') AS handle \gset
+SELECT string_agg(DISTINCT relation, ',') AS relations FROM hypocost_prepared_costs(:handle);
+SET enable_partition_pruning = off;
+SET constraint_exclusion = off;
+SELECT string_agg(DISTINCT relation, ',') AS relations FROM hypocost_prepared_costs(:handle);
+RESET enable_partition_pruning;
+RESET constraint_exclusion;
+SELECT hypocost_deallocate(:handle);
+
+-- DML is recosted over its subpath; only RETURNING passes rows up.
+WITH c AS (SELECT * FROM hypocost_costs('UPDATE hc_t SET v = v + 1 FROM hc_p WHERE hc_t.id = hc_p.v AND hc_p.k = 1'))
+SELECT m.rows = 0 AS no_rows, m.rows = s.rows AS passthrough,
+       abs(m.total_cost - s.total_cost) < 1e-6 AS subpath_cost
+  FROM c m JOIN c s ON s.parent_id = m.node_id
+ WHERE m.node_type = 'ModifyTable';
+WITH c AS (SELECT * FROM hypocost_costs('UPDATE hc_t SET v = v + 1 FROM hc_p WHERE hc_t.id = hc_p.v AND hc_p.k = 1 RETURNING hc_t.id'))
+SELECT m.rows = 0 AS no_rows, m.rows = s.rows AS passthrough,
+       abs(m.total_cost - s.total_cost) < 1e-6 AS subpath_cost
+  FROM c m JOIN c s ON s.parent_id = m.node_id
+ WHERE m.node_type = 'ModifyTable';
+WITH c AS (SELECT * FROM hypocost_costs('DELETE FROM hc_t USING hc_p WHERE hc_t.id = hc_p.v AND hc_p.k = 2'))
+SELECT m.rows = 0 AS no_rows, m.rows = s.rows AS passthrough,
+       abs(m.total_cost - s.total_cost) < 1e-6 AS subpath_cost
+  FROM c m JOIN c s ON s.parent_id = m.node_id
+ WHERE m.node_type = 'ModifyTable';
+-- Locking charges a tuple's CPU cost per row.
+WITH c AS (SELECT * FROM hypocost_costs('SELECT * FROM hc_t WHERE id < 100 FOR UPDATE'))
+SELECT l.rows = s.rows AS passthrough,
+       abs(l.total_cost - (s.total_cost + current_setting('cpu_tuple_cost')::float8 * s.rows)) < 1e-6 AS charged
+  FROM c l JOIN c s ON s.parent_id = l.node_id
+ WHERE l.node_type = 'LockRows';
+SET hypocost.cpu_tuple_cost = 1;
+WITH c AS (SELECT * FROM hypocost_costs('SELECT * FROM hc_t WHERE id < 100 FOR UPDATE'))
+SELECT abs(l.total_cost - (s.total_cost + s.rows)) < 1e-6 AS charged
+  FROM c l JOIN c s ON s.parent_id = l.node_id
+ WHERE l.node_type = 'LockRows';
+RESET hypocost.cpu_tuple_cost;
+
+-- Statement evictions are counted until the next reset.
+SELECT hypocost_stat_reset();
+SELECT dealloc FROM pg_stat_hypocost_info;
+
+-- Each sweep configuration matches hypocost_costs under its page costs.
+SET hypocost.random_page_cost = 40;
+SELECT total_cost AS recosted FROM hypocost_costs('SELECT * FROM hc_t WHERE id = 42') WHERE parent_id IS NULL \gset
+RESET hypocost.random_page_cost;
+SELECT config, abs(total_cost - :recosted) < 1e-6 AS matches, pruned
+  FROM hypocost_sweep('SELECT * FROM hc_t WHERE id = 42', ARRAY[1, 1], ARRAY[4, 40])
+ ORDER BY config;
+
+-- A configuration over budget is pruned and keeps only a lower bound. Cached
+-- results are complete, so start from an empty cache.
+SELECT hypocost_cache_reset();
+SELECT config, pruned, startup_cost IS NULL AS no_startup, total_cost > 20 AS over_budget
+  FROM hypocost_sweep('SELECT * FROM hc_t WHERE id = 42', ARRAY[1, 1], ARRAY[4, 40], budget => 20)
+ ORDER BY config;
+SET hypocost.cost_budget = 20;
+SELECT config, pruned FROM hypocost_sweep('SELECT * FROM hc_t WHERE id = 42', ARRAY[1], ARRAY[40]);
+RESET hypocost.cost_budget;
+
+-- Coefficients reproduce the recosted total under other page costs.
+SET hypocost.random_page_cost = 40;
+SELECT total_cost AS recosted FROM hypocost_costs('SELECT * FROM hc_t WHERE id = 42') WHERE parent_id IS NULL \gset
+RESET hypocost.random_page_cost;
+SELECT linear,
+       abs(constant_cost + seq_page_coef * 1 + random_page_coef * 40
+           + cpu_tuple_coef * current_setting('cpu_tuple_cost')::float8
+           + cpu_index_tuple_coef * current_setting('cpu_index_tuple_cost')::float8
+           + cpu_operator_coef * current_setting('cpu_operator_cost')::float8
+           - :recosted) < 1e-6 * :recosted AS reproduces
+  FROM hypocost_coefficients('SELECT * FROM hc_t WHERE id = 42')
+ WHERE parent_id IS NULL;
+-- A sort that spills is not linear; the scan below it still is.
+SET work_mem = '64kB';
+SELECT node_id, node_type, linear, nonlinear_reason
+  FROM hypocost_coefficients('SELECT * FROM hc_t ORDER BY v')
+ ORDER BY node_id;
+RESET work_mem;
+
+-- Rules match index names by substring. A rule added after a scan was looked up
+-- still applies to it.
+CREATE INDEX hc_t_v_idx ON hc_t (v);
+CREATE INDEX hc_t_v_id_idx ON hc_t (v, id);
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+SET hypocost.substitute = on;
+SELECT hypocost_substitute_index('no_such_index', 'hc_t_v_id_idx');
+SELECT index_name FROM hypocost_costs('SELECT * FROM hc_t WHERE v < 50') WHERE index_name IS NOT NULL;
+SELECT hypocost_substitute_index('t_v_idx', 'hc_t_v_id_idx');
+SELECT index_name, total_cost > original_total_cost AS dearer
+  FROM hypocost_costs('SELECT * FROM hc_t WHERE v < 50')
+ WHERE index_name IS NOT NULL;
+SELECT hypocost_substitute_reset();
+RESET hypocost.substitute;
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+DROP INDEX hc_t_v_idx, hc_t_v_id_idx;
+
+-- Scans of the same relation share its rebuilt copy and are each substituted.
+CREATE INDEX hc_t_v_idx ON hc_t (v);
+CREATE INDEX hc_t_v_id_idx ON hc_t (v, id);
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+SET hypocost.substitute = on;
+SELECT hypocost_substitute_index('t_v_idx', 'hc_t_v_id_idx');
+SELECT count(*) AS substituted
+  FROM hypocost_costs('SELECT * FROM hc_t a, hc_t b WHERE a.v < 50 AND b.v >= 50')
+ WHERE index_name = 'hc_t_v_id_idx';
+SELECT hypocost_substitute_reset();
+RESET hypocost.substitute;
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+DROP INDEX hc_t_v_idx, hc_t_v_id_idx;
+
+-- Every matching rule is a candidate. The first registered one is used unless
+-- the cheapest is asked for.
+CREATE INDEX hc_t_v_idx ON hc_t (v);
+CREATE INDEX hc_t_v_id_idx ON hc_t (v, id);
+CREATE INDEX hc_t_v_id_id_idx ON hc_t (v, id, id);
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+SET hypocost.substitute = on;
+SELECT hypocost_substitute_index('t_v_idx', 'hc_t_v_id_id_idx');
+SELECT hypocost_substitute_index('t_v_idx', 'hc_t_v_id_idx');
+SELECT candidate_index, chosen
+  FROM hypocost_candidates('SELECT * FROM hc_t WHERE v < 50')
+ ORDER BY candidate_index;
+SET hypocost.substitute_mode = cheapest;
+SELECT candidate_index, chosen
+  FROM hypocost_candidates('SELECT * FROM hc_t WHERE v < 50')
+ ORDER BY candidate_index;
+SELECT index_name FROM hypocost_costs('SELECT * FROM hc_t WHERE v < 50') WHERE index_name IS NOT NULL;
+RESET hypocost.substitute_mode;
+SELECT hypocost_substitute_reset();
+RESET hypocost.substitute;
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+DROP INDEX hc_t_v_idx, hc_t_v_id_idx, hc_t_v_id_id_idx;
+
+-- Sorts and hash joins spill under the hypothetical work_mem.
+SELECT node_type, memory_limit, spills, batches FROM hypocost_memory('SELECT * FROM hc_t ORDER BY v');
+SET hypocost.work_mem = 64;
+SELECT node_type, memory_limit, spills, batches FROM hypocost_memory('SELECT * FROM hc_t ORDER BY v');
+SET hypocost.hash_mem_multiplier = 1;
+SELECT node_type, memory_limit, spills, batches > 1 AS batched
+  FROM hypocost_memory('SELECT * FROM hc_t a JOIN hc_t b ON a.v = b.id');
+RESET hypocost.work_mem;
+RESET hypocost.hash_mem_multiplier;
+SELECT node_type, memory_limit, spills, batches > 1 AS batched
+  FROM hypocost_memory('SELECT * FROM hc_t a JOIN hc_t b ON a.v = b.id');
+
+-- Memoize hit ratios follow the outer rows of the recost.
+SET enable_hashjoin = off;
+SET enable_mergejoin = off;
+SELECT hit_ratio > 0.8 AS hits, evict_ratio = 0 AS no_evictions, memory_limit
+  FROM hypocost_memoize('SELECT * FROM hc_t a JOIN hc_t b ON b.id = a.v WHERE a.id < 1000');
+WITH c AS (SELECT * FROM hypocost_costs('SELECT * FROM hc_t a JOIN hc_t b ON b.id = a.v WHERE a.id < 1000'))
+SELECT o.node_id AS outer_id
+  FROM c o JOIN c n ON n.node_id = o.parent_id
+ WHERE n.node_type = 'Nested Loop' AND o.node_type <> 'Memoize' \gset
+SELECT hypocost_inject_rows('SELECT * FROM hc_t a JOIN hc_t b ON b.id = a.v WHERE a.id < 1000', :outer_id, 50);
+SELECT calls, hit_ratio FROM hypocost_memoize('SELECT * FROM hc_t a JOIN hc_t b ON b.id = a.v WHERE a.id < 1000');
+SELECT hypocost_whatif_reset();
+RESET enable_hashjoin;
+RESET enable_mergejoin;
+
+-- pg_stat_hypocost accumulates per query fingerprint.
+SELECT hypocost_cache_reset();
+SELECT hypocost_stat_reset();
+SELECT count(*) > 0 AS has_nodes FROM hypocost_costs('SELECT * FROM hc_t WHERE id = 7');
+SELECT count(*) > 0 AS has_nodes FROM hypocost_costs('SELECT * FROM hc_t WHERE id = 8');
+SELECT count(*) AS statements, bool_and(dbid = (SELECT oid FROM pg_database WHERE datname = current_database())) AS this_db,
+       bool_and(recosts = 2) AS both_counted, bool_and(substitutions_attempted = 0) AS no_substitutions
+  FROM pg_stat_hypocost;
+
+-- A repeated recost is answered from the cache; other settings miss it.
+SELECT sum(recosts) AS recosts FROM pg_stat_hypocost \gset
+SELECT count(*) > 0 AS has_nodes FROM hypocost_costs('SELECT * FROM hc_t WHERE id = 7');
+SELECT sum(recosts) = :recosts AS cached FROM pg_stat_hypocost;
+SET hypocost.random_page_cost = 40;
+SELECT count(*) > 0 AS has_nodes FROM hypocost_costs('SELECT * FROM hc_t WHERE id = 7');
+SELECT sum(recosts) = :recosts + 1 AS recosted FROM pg_stat_hypocost;
+RESET hypocost.random_page_cost;
+SELECT hypocost_cache_reset();
+SELECT count(*) > 0 AS has_nodes FROM hypocost_costs('SELECT * FROM hc_t WHERE id = 7');
+SELECT sum(recosts) = :recosts + 2 AS recosted FROM pg_stat_hypocost;
+
+-- Page costs of one partition or one index only change scans of it.
+SELECT hypocost_set_page_costs('hc_p_1', seq_page_cost => 10);
+SELECT relation, abs(total_cost - original_total_cost) > 1e-6 AS changed
+  FROM hypocost_costs('SELECT * FROM hc_t, hc_p WHERE hc_t.id = 42 AND hc_p.k = 1 AND hc_p.v = 42')
+ WHERE relation IS NOT NULL
+ ORDER BY relation;
+SELECT hypocost_whatif_reset();
+SELECT hypocost_set_page_costs('hc_t_pkey', random_page_cost => 40);
+SELECT relation, abs(total_cost - original_total_cost) > 1e-6 AS changed
+  FROM hypocost_costs('SELECT * FROM hc_t, hc_p WHERE hc_t.id = 42 AND hc_p.k = 1 AND hc_p.v = 42')
+ WHERE relation IS NOT NULL
+ ORDER BY relation;
+SELECT hypocost_whatif_reset();
+
+-- Gathers are recosted with the hypothetical workers, along with the partial
+-- scan below them.
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+SET hypocost.parallel_workers = 4;
+SELECT node_type, total_cost < original_total_cost AS cheaper
+  FROM hypocost_costs('SELECT count(*) FROM hc_t')
+ WHERE node_type IN ('Gather', 'Seq Scan')
+ ORDER BY node_type;
+RESET hypocost.parallel_workers;
+WITH c AS (SELECT * FROM hypocost_costs('SELECT count(*) FROM hc_t'))
+SELECT node_id AS gather_id FROM c WHERE node_type = 'Gather' \gset
+SELECT hypocost_set_gather_workers('SELECT count(*) FROM hc_t', :gather_id, 1);
+SELECT node_type, total_cost > original_total_cost AS dearer
+  FROM hypocost_costs('SELECT count(*) FROM hc_t')
+ WHERE node_type IN ('Gather', 'Seq Scan')
+ ORDER BY node_type;
+SELECT hypocost_whatif_reset();
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+
+-- Argument checks.
+SELECT hypocost_set_correlation('hc_t_pkey', 2);
+SELECT hypocost_set_page_costs('hc_t', -1, NULL);
+SELECT hypocost_set_gather_workers('SELECT * FROM hc_t', 0, 0);
+SELECT * FROM hypocost_costs('SELECT 1; SELECT 2');
+SELECT * FROM hypocost_costs('VACUUM hc_t');
+
+-- Settings checks.
+SET hypocost.work_mem = 32;
+SET hypocost.hash_mem_multiplier = 0.5;
+SET hypocost.parallel_workers = 0;
+
+DROP TABLE hc_t, hc_p;
+DROP EXTENSION hypocost;